@@ -0,0 +1,83 @@
+#include <cstdlib>
+#include <iterator>
+#include "capture-pool.h"
+
+static unsigned char *AllocateAligned(size_t size)
+{
+  const size_t rounded = (size + CAPTURE_ALIGNMENT - 1) / CAPTURE_ALIGNMENT * CAPTURE_ALIGNMENT;
+  return (unsigned char *)std::aligned_alloc(CAPTURE_ALIGNMENT, rounded);
+}
+
+CapturePool::CapturePool(size_t max_idle_bytes) : max_idle_bytes(max_idle_bytes), idle_bytes(0) {}
+
+CapturePool::~CapturePool()
+{
+  for (const auto& buffer : idle) std::free(buffer.data);
+}
+
+unsigned char *CapturePool::Acquire(size_t size)
+{
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+
+    // Most recently released first, it is the most likely to still be cached
+    for (auto buffer = idle.rbegin(); buffer != idle.rend(); ++buffer)
+    {
+      if (buffer->size != size) continue;
+
+      unsigned char *data = buffer->data;
+      idle_bytes -= size;
+      idle.erase(std::next(buffer).base());
+      in_use[data] = size;
+
+      return data;
+    }
+  }
+
+  unsigned char *data = AllocateAligned(size);
+  if (data == nullptr) return nullptr;
+
+  std::lock_guard<std::mutex> lock(mutex);
+  in_use[data] = size;
+
+  return data;
+}
+
+void CapturePool::Release(unsigned char *buffer)
+{
+  if (buffer == nullptr) return;
+
+  std::lock_guard<std::mutex> lock(mutex);
+
+  auto used = in_use.find(buffer);
+  if (used == in_use.end()) return;
+
+  idle.push_back({ buffer, used->second });
+  idle_bytes += used->second;
+  in_use.erase(used);
+
+  TrimLocked();
+}
+
+size_t CapturePool::IdleBytes()
+{
+  std::lock_guard<std::mutex> lock(mutex);
+  return idle_bytes;
+}
+
+void CapturePool::TrimLocked()
+{
+  while (!idle.empty() && idle_bytes > max_idle_bytes)
+  {
+    std::free(idle.front().data);
+    idle_bytes -= idle.front().size;
+    idle.erase(idle.begin());
+  }
+}
+
+CapturePool& DefaultCapturePool()
+{
+  // Never destroyed, images released during static destruction still need it
+  static CapturePool *pool = new CapturePool();
+  return *pool;
+}
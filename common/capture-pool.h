@@ -0,0 +1,43 @@
+#pragma once
+#include <cstddef>
+#include <map>
+#include <mutex>
+#include <vector>
+
+constexpr size_t CAPTURE_ALIGNMENT = 64;
+
+// Recycles the large pixel buffers frame captures need, so long runs don't
+// allocate and fault in a fresh frame every time. Buffers are 64 byte
+// aligned for the SIMD kernels. Released buffers are kept for reuse up to
+// `max_idle_bytes`, dropping the oldest first, e.g. after a resize.
+class CapturePool
+{
+  public:
+    explicit CapturePool(size_t max_idle_bytes = 64 * 1024 * 1024);
+    CapturePool(const CapturePool&) = delete;
+    CapturePool& operator=(const CapturePool&) = delete;
+    ~CapturePool();
+
+    // A buffer of exactly `size` usable bytes, reused when one is idle.
+    unsigned char *Acquire(size_t size);
+    void Release(unsigned char *buffer);
+
+    size_t IdleBytes();
+
+  private:
+    struct Buffer
+    {
+      unsigned char *data;
+      size_t size;
+    };
+
+    void TrimLocked();
+
+    std::mutex mutex;
+    size_t max_idle_bytes;
+    size_t idle_bytes;
+    std::vector<Buffer> idle;
+    std::map<unsigned char *, size_t> in_use;
+};
+
+CapturePool& DefaultCapturePool();
@@ -0,0 +1,500 @@
+#include "compare-kernels.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+
+#if defined(__x86_64__)
+#include <immintrin.h>
+#endif
+
+constexpr int COLOUR_CHANNELS = 3;
+
+// 32 bit lanes receive at most 4*255^2 per vector step, so they are widened
+// to 64 bit totals before this many steps can overflow them.
+constexpr size_t FLUSH_INTERVAL = 4096;
+
+void DifferenceAccumulator::Merge(const DifferenceAccumulator& other)
+{
+  sum_squares += other.sum_squares;
+  pixel_count += other.pixel_count;
+  differing_pixels += other.differing_pixels;
+  max_difference = std::max(max_difference, other.max_difference);
+}
+
+double DifferenceAccumulator::Rmse() const
+{
+  if (pixel_count == 0) return 0.0;
+  return std::sqrt((double)sum_squares / (double)(pixel_count * COLOUR_CHANNELS)) / 255.0;
+}
+
+static void AccumulateDifferenceScalar(const unsigned char *a, const unsigned char *b, size_t begin, size_t end, DifferenceAccumulator *acc)
+{
+  for (size_t i = begin; i < end; ++i)
+  {
+    bool differs = false;
+
+    for (int c = 0; c < COLOUR_CHANNELS; ++c)
+    {
+      int d = std::abs((int)a[i * 4 + c] - (int)b[i * 4 + c]);
+      acc->sum_squares += d * d;
+      acc->max_difference = std::max(acc->max_difference, d);
+      differs |= d != 0;
+    }
+
+    acc->differing_pixels += differs;
+  }
+
+  acc->pixel_count += end - begin;
+}
+
+#if defined(__x86_64__)
+static int HorizontalMax(const unsigned char *bytes, int count)
+{
+  int max = 0;
+  for (int i = 0; i < count; ++i) max = std::max(max, (int)bytes[i]);
+  return max;
+}
+
+__attribute__((target("avx2")))
+static void AccumulateDifferenceAvx2(const unsigned char *a, const unsigned char *b, size_t pixel_count, DifferenceAccumulator *acc)
+{
+  const __m256i colour_mask = _mm256_set1_epi32(0x00FFFFFF);
+  const __m256i zero = _mm256_setzero_si256();
+  const size_t vector_end = pixel_count & ~(size_t)7;
+  __m256i max = zero;
+  __m256i sum64 = zero;
+  uint64_t differing = 0;
+  size_t i = 0;
+
+  while (i < vector_end)
+  {
+    const size_t block_end = std::min(vector_end, i + 8 * FLUSH_INTERVAL);
+    __m256i sum32 = zero;
+
+    for (; i < block_end; i += 8)
+    {
+      __m256i va = _mm256_loadu_si256((const __m256i *)(a + i * 4));
+      __m256i vb = _mm256_loadu_si256((const __m256i *)(b + i * 4));
+      __m256i diff = _mm256_and_si256(_mm256_or_si256(_mm256_subs_epu8(va, vb), _mm256_subs_epu8(vb, va)), colour_mask);
+
+      max = _mm256_max_epu8(max, diff);
+
+      __m256i same = _mm256_cmpeq_epi32(diff, zero);
+      differing += 8 - __builtin_popcount(_mm256_movemask_ps(_mm256_castsi256_ps(same)));
+
+      __m256i lo = _mm256_unpacklo_epi8(diff, zero);
+      __m256i hi = _mm256_unpackhi_epi8(diff, zero);
+      sum32 = _mm256_add_epi32(sum32, _mm256_madd_epi16(lo, lo));
+      sum32 = _mm256_add_epi32(sum32, _mm256_madd_epi16(hi, hi));
+    }
+
+    sum64 = _mm256_add_epi64(sum64, _mm256_unpacklo_epi32(sum32, zero));
+    sum64 = _mm256_add_epi64(sum64, _mm256_unpackhi_epi32(sum32, zero));
+  }
+
+  alignas(32) uint64_t sums[4];
+  alignas(32) unsigned char maxes[32];
+  _mm256_store_si256((__m256i *)sums, sum64);
+  _mm256_store_si256((__m256i *)maxes, max);
+
+  acc->sum_squares += sums[0] + sums[1] + sums[2] + sums[3];
+  acc->differing_pixels += differing;
+  acc->pixel_count += vector_end;
+  acc->max_difference = std::max(acc->max_difference, HorizontalMax(maxes, 32));
+
+  AccumulateDifferenceScalar(a, b, vector_end, pixel_count, acc);
+}
+
+static void AccumulateDifferenceSse2(const unsigned char *a, const unsigned char *b, size_t pixel_count, DifferenceAccumulator *acc)
+{
+  const __m128i colour_mask = _mm_set1_epi32(0x00FFFFFF);
+  const __m128i zero = _mm_setzero_si128();
+  const size_t vector_end = pixel_count & ~(size_t)3;
+  __m128i max = zero;
+  __m128i sum64 = zero;
+  uint64_t differing = 0;
+  size_t i = 0;
+
+  while (i < vector_end)
+  {
+    const size_t block_end = std::min(vector_end, i + 4 * FLUSH_INTERVAL);
+    __m128i sum32 = zero;
+
+    for (; i < block_end; i += 4)
+    {
+      __m128i va = _mm_loadu_si128((const __m128i *)(a + i * 4));
+      __m128i vb = _mm_loadu_si128((const __m128i *)(b + i * 4));
+      __m128i diff = _mm_and_si128(_mm_or_si128(_mm_subs_epu8(va, vb), _mm_subs_epu8(vb, va)), colour_mask);
+
+      max = _mm_max_epu8(max, diff);
+
+      __m128i same = _mm_cmpeq_epi32(diff, zero);
+      differing += 4 - __builtin_popcount(_mm_movemask_ps(_mm_castsi128_ps(same)));
+
+      __m128i lo = _mm_unpacklo_epi8(diff, zero);
+      __m128i hi = _mm_unpackhi_epi8(diff, zero);
+      sum32 = _mm_add_epi32(sum32, _mm_madd_epi16(lo, lo));
+      sum32 = _mm_add_epi32(sum32, _mm_madd_epi16(hi, hi));
+    }
+
+    sum64 = _mm_add_epi64(sum64, _mm_unpacklo_epi32(sum32, zero));
+    sum64 = _mm_add_epi64(sum64, _mm_unpackhi_epi32(sum32, zero));
+  }
+
+  alignas(16) uint64_t sums[2];
+  alignas(16) unsigned char maxes[16];
+  _mm_store_si128((__m128i *)sums, sum64);
+  _mm_store_si128((__m128i *)maxes, max);
+
+  acc->sum_squares += sums[0] + sums[1];
+  acc->differing_pixels += differing;
+  acc->pixel_count += vector_end;
+  acc->max_difference = std::max(acc->max_difference, HorizontalMax(maxes, 16));
+
+  AccumulateDifferenceScalar(a, b, vector_end, pixel_count, acc);
+}
+#endif
+
+void AccumulateDifferencePortable(const unsigned char *a, const unsigned char *b, size_t pixel_count, DifferenceAccumulator *acc)
+{
+  AccumulateDifferenceScalar(a, b, 0, pixel_count, acc);
+}
+
+static void AccumulateBlockMomentsScalar(const unsigned char *a, const unsigned char *b, size_t stride, size_t begin, size_t end, BlockMoments *out)
+{
+  for (size_t block = begin; block < end; ++block)
+  {
+    BlockMoments m = { 0, 0, 0, 0 };
+
+    for (int y = 0; y < 4; ++y)
+    {
+      for (int x = 0; x < 4; ++x)
+      {
+        int va = a[y * stride + block * 4 + x];
+        int vb = b[y * stride + block * 4 + x];
+        m.sum_a += va;
+        m.sum_b += vb;
+        m.sum_squares += va * va + vb * vb;
+        m.sum_products += va * vb;
+      }
+    }
+
+    out[block] = m;
+  }
+}
+
+#if defined(__x86_64__)
+__attribute__((target("avx2")))
+static void AccumulateBlockMomentsAvx2(const unsigned char *a, const unsigned char *b, size_t stride, size_t blocks, BlockMoments *out)
+{
+  const __m256i ones = _mm256_set1_epi16(1);
+  const size_t vector_end = blocks & ~(size_t)3;
+
+  for (size_t block = 0; block < vector_end; block += 4)
+  {
+    __m256i sum_a = _mm256_setzero_si256();
+    __m256i sum_b = _mm256_setzero_si256();
+    __m256i sum_squares = _mm256_setzero_si256();
+    __m256i sum_products = _mm256_setzero_si256();
+
+    for (int y = 0; y < 4; ++y)
+    {
+      __m256i va = _mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i *)(a + y * stride + block * 4)));
+      __m256i vb = _mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i *)(b + y * stride + block * 4)));
+
+      sum_a = _mm256_add_epi16(sum_a, va);
+      sum_b = _mm256_add_epi16(sum_b, vb);
+      sum_squares = _mm256_add_epi32(sum_squares, _mm256_madd_epi16(va, va));
+      sum_squares = _mm256_add_epi32(sum_squares, _mm256_madd_epi16(vb, vb));
+      sum_products = _mm256_add_epi32(sum_products, _mm256_madd_epi16(va, vb));
+    }
+
+    // Pairs of columns are folded by madd, the hadd folds them into blocks:
+    // [a0 a1 b0 b1 | a2 a3 b2 b3] with one lane per 4x4 block.
+    __m256i sums = _mm256_hadd_epi32(_mm256_madd_epi16(sum_a, ones), _mm256_madd_epi16(sum_b, ones));
+    __m256i squares = _mm256_hadd_epi32(sum_squares, sum_products);
+
+    alignas(32) int32_t s[8], q[8];
+    _mm256_store_si256((__m256i *)s, sums);
+    _mm256_store_si256((__m256i *)q, squares);
+
+    const int lane[4] = { 0, 1, 4, 5 };
+    for (int j = 0; j < 4; ++j)
+      out[block + j] = { s[lane[j]], s[lane[j] + 2], q[lane[j]], q[lane[j] + 2] };
+  }
+
+  AccumulateBlockMomentsScalar(a, b, stride, vector_end, blocks, out);
+}
+#endif
+
+void AccumulateBlockMomentsPortable(const unsigned char *a, const unsigned char *b, size_t stride, size_t blocks, BlockMoments *out)
+{
+  AccumulateBlockMomentsScalar(a, b, stride, 0, blocks, out);
+}
+
+static void SumRgbaBlocksScalar(const unsigned char *rgba, size_t stride, size_t begin, size_t end, uint16_t *out)
+{
+  for (size_t block = begin; block < end; ++block)
+  {
+    for (int c = 0; c < 4; ++c)
+    {
+      int sum = 0;
+
+      for (int y = 0; y < 4; ++y)
+        for (int x = 0; x < 4; ++x)
+          sum += rgba[y * stride + (block * 4 + x) * 4 + c];
+
+      out[block * 4 + c] = (uint16_t)sum;
+    }
+  }
+}
+
+static void SumBlockPairsScalar(const uint16_t *row0, const uint16_t *row1, size_t begin, size_t end, uint16_t *out)
+{
+  for (size_t block = begin; block < end; ++block)
+    for (int c = 0; c < 4; ++c)
+      out[block * 4 + c] = row0[block * 8 + c] + row0[block * 8 + 4 + c] + row1[block * 8 + c] + row1[block * 8 + 4 + c];
+}
+
+#if defined(__x86_64__)
+__attribute__((target("avx2")))
+static void SumRgbaBlocksAvx2(const unsigned char *rgba, size_t stride, size_t blocks, uint16_t *out)
+{
+  const size_t vector_end = blocks & ~(size_t)1;
+
+  for (size_t block = 0; block < vector_end; block += 2)
+  {
+    __m256i a = _mm256_setzero_si256();
+    __m256i b = _mm256_setzero_si256();
+
+    for (int y = 0; y < 4; ++y)
+    {
+      const unsigned char *row = rgba + y * stride + block * 16;
+      a = _mm256_add_epi16(a, _mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i *)row)));
+      b = _mm256_add_epi16(b, _mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i *)(row + 16))));
+    }
+
+    // a and b hold 4 columns of RGBA sums each, fold them into one pixel:
+    // [a0+a2 a1+a3 | b0+b2 b1+b3], then add the neighbouring 64 bit halves
+    __m256i folded = _mm256_add_epi16(_mm256_permute2x128_si256(a, b, 0x20), _mm256_permute2x128_si256(a, b, 0x31));
+    folded = _mm256_add_epi16(folded, _mm256_shuffle_epi32(folded, _MM_SHUFFLE(1, 0, 3, 2)));
+
+    _mm_storeu_si128((__m128i *)(out + block * 4), _mm256_castsi256_si128(_mm256_permute4x64_epi64(folded, _MM_SHUFFLE(2, 0, 2, 0))));
+  }
+
+  SumRgbaBlocksScalar(rgba, stride, vector_end, blocks, out);
+}
+
+__attribute__((target("avx2")))
+static void SumBlockPairsAvx2(const uint16_t *row0, const uint16_t *row1, size_t blocks, uint16_t *out)
+{
+  const size_t vector_end = blocks & ~(size_t)1;
+
+  for (size_t block = 0; block < vector_end; block += 2)
+  {
+    __m256i sum = _mm256_add_epi16(_mm256_loadu_si256((const __m256i *)(row0 + block * 8)),
+                                   _mm256_loadu_si256((const __m256i *)(row1 + block * 8)));
+    sum = _mm256_add_epi16(sum, _mm256_shuffle_epi32(sum, _MM_SHUFFLE(1, 0, 3, 2)));
+
+    _mm_storeu_si128((__m128i *)(out + block * 4), _mm256_castsi256_si128(_mm256_permute4x64_epi64(sum, _MM_SHUFFLE(2, 0, 2, 0))));
+  }
+
+  SumBlockPairsScalar(row0, row1, vector_end, blocks, out);
+}
+#endif
+
+void SumRgbaBlocksPortable(const unsigned char *rgba, size_t stride, size_t blocks, uint16_t *out)
+{
+  SumRgbaBlocksScalar(rgba, stride, 0, blocks, out);
+}
+
+void SumBlockPairsPortable(const uint16_t *row0, const uint16_t *row1, size_t blocks, uint16_t *out)
+{
+  SumBlockPairsScalar(row0, row1, 0, blocks, out);
+}
+
+// Hashing follows the XXH3 accumulate step: every 32 byte stripe is mixed
+// into four 64 bit lanes with a key that advances per stripe, so moving
+// content around changes the hash.
+constexpr uint64_t HASH_KEYS[4] = { 0x9E3779B185EBCA87ULL, 0xC2B2AE3D27D4EB4FULL, 0x165667B19E3779F9ULL, 0x85EBCA77C2B2AE63ULL };
+constexpr uint64_t HASH_KEY_STEP = 0x27D4EB2F165667C5ULL;
+constexpr size_t HASH_STRIPE = 32;
+
+struct HashState
+{
+  uint64_t acc[4] = { HASH_KEYS[0], HASH_KEYS[1], HASH_KEYS[2], HASH_KEYS[3] };
+  uint64_t stripes = 0;
+};
+
+static void HashStripeScalar(const unsigned char *stripe, HashState *state)
+{
+  uint64_t data[4];
+  std::memcpy(data, stripe, sizeof(data));
+
+  for (int lane = 0; lane < 4; ++lane)
+  {
+    const uint64_t key = HASH_KEYS[lane] + state->stripes * HASH_KEY_STEP;
+    const uint64_t mixed = data[lane] ^ key;
+    state->acc[lane ^ 1] += data[lane];
+    state->acc[lane] += (mixed & 0xFFFFFFFFULL) * (mixed >> 32);
+  }
+
+  state->stripes++;
+}
+
+static void HashTailScalar(const unsigned char *data, size_t size, HashState *state)
+{
+  if (size == 0) return;
+
+  unsigned char stripe[HASH_STRIPE] = { 0 };
+  std::memcpy(stripe, data, size);
+  HashStripeScalar(stripe, state);
+}
+
+static uint64_t HashFinish(const HashState& state, uint64_t length)
+{
+  uint64_t h = length * 0x9E3779B185EBCA87ULL;
+
+  for (int lane = 0; lane < 4; ++lane)
+  {
+    uint64_t v = state.acc[lane] ^ (state.acc[lane] >> 29);
+    v *= 0xBF58476D1CE4E5B9ULL;
+    h = (h ^ v ^ (v >> 32)) * 0x94D049BB133111EBULL;
+  }
+
+  h ^= h >> 37;
+  h *= 0x165667919E3779F9ULL;
+  h ^= h >> 32;
+
+  return h;
+}
+
+static void HashRunScalar(const unsigned char *data, size_t size, HashState *state)
+{
+  const size_t vector_end = size - size % HASH_STRIPE;
+
+  for (size_t i = 0; i < vector_end; i += HASH_STRIPE)
+    HashStripeScalar(data + i, state);
+
+  HashTailScalar(data + vector_end, size - vector_end, state);
+}
+
+#if defined(__x86_64__)
+__attribute__((target("avx2")))
+static void HashRunAvx2(const unsigned char *data, size_t size, HashState *state)
+{
+  const size_t vector_end = size - size % HASH_STRIPE;
+  const __m256i step = _mm256_set1_epi64x(HASH_KEY_STEP);
+  __m256i acc = _mm256_loadu_si256((const __m256i *)state->acc);
+  __m256i key = _mm256_add_epi64(_mm256_loadu_si256((const __m256i *)HASH_KEYS), _mm256_set1_epi64x(state->stripes * HASH_KEY_STEP));
+
+  for (size_t i = 0; i < vector_end; i += HASH_STRIPE)
+  {
+    __m256i v = _mm256_loadu_si256((const __m256i *)(data + i));
+    __m256i mixed = _mm256_xor_si256(v, key);
+    __m256i product = _mm256_mul_epu32(mixed, _mm256_srli_epi64(mixed, 32));
+    __m256i swapped = _mm256_shuffle_epi32(v, _MM_SHUFFLE(1, 0, 3, 2));
+    acc = _mm256_add_epi64(acc, _mm256_add_epi64(product, swapped));
+    key = _mm256_add_epi64(key, step);
+  }
+
+  _mm256_storeu_si256((__m256i *)state->acc, acc);
+  state->stripes += vector_end / HASH_STRIPE;
+
+  HashTailScalar(data + vector_end, size - vector_end, state);
+}
+#endif
+
+using HashKernel = void (*)(const unsigned char *, size_t, HashState *);
+
+static HashKernel SelectHashKernel()
+{
+#if defined(__x86_64__)
+  if (__builtin_cpu_supports("avx2")) return HashRunAvx2;
+#endif
+  return HashRunScalar;
+}
+
+static uint64_t HashPixelsWith(HashKernel kernel, const unsigned char *pixels, size_t stride, int width, int height)
+{
+  HashState state;
+
+  for (int y = 0; y < height; ++y)
+    kernel(pixels + y * stride, (size_t)width * 4, &state);
+
+  return HashFinish(state, ((uint64_t)width << 32) | (uint64_t)height);
+}
+
+uint64_t HashPixels(const unsigned char *pixels, size_t stride, int width, int height)
+{
+  static const HashKernel kernel = SelectHashKernel();
+  return HashPixelsWith(kernel, pixels, stride, width, height);
+}
+
+uint64_t HashPixelsPortable(const unsigned char *pixels, size_t stride, int width, int height)
+{
+  return HashPixelsWith(HashRunScalar, pixels, stride, width, height);
+}
+
+uint64_t HashBytes(const unsigned char *data, size_t size)
+{
+  static const HashKernel kernel = SelectHashKernel();
+  HashState state;
+
+  kernel(data, size, &state);
+
+  return HashFinish(state, size);
+}
+
+using DifferenceKernel = void (*)(const unsigned char *, const unsigned char *, size_t, DifferenceAccumulator *);
+
+static DifferenceKernel SelectDifferenceKernel()
+{
+#if defined(__x86_64__)
+  if (__builtin_cpu_supports("avx2")) return AccumulateDifferenceAvx2;
+  if (__builtin_cpu_supports("sse2")) return AccumulateDifferenceSse2;
+#endif
+  return AccumulateDifferencePortable;
+}
+
+void AccumulateDifference(const unsigned char *a, const unsigned char *b, size_t pixel_count, DifferenceAccumulator *acc)
+{
+  static const DifferenceKernel kernel = SelectDifferenceKernel();
+  kernel(a, b, pixel_count, acc);
+}
+
+using BlockMomentsKernel = void (*)(const unsigned char *, const unsigned char *, size_t, size_t, BlockMoments *);
+
+void AccumulateBlockMoments(const unsigned char *a, const unsigned char *b, size_t stride, size_t blocks, BlockMoments *out)
+{
+#if defined(__x86_64__)
+  static const BlockMomentsKernel kernel = __builtin_cpu_supports("avx2") ? AccumulateBlockMomentsAvx2 : AccumulateBlockMomentsPortable;
+#else
+  static const BlockMomentsKernel kernel = AccumulateBlockMomentsPortable;
+#endif
+  kernel(a, b, stride, blocks, out);
+}
+
+using SumRgbaBlocksKernel = void (*)(const unsigned char *, size_t, size_t, uint16_t *);
+using SumBlockPairsKernel = void (*)(const uint16_t *, const uint16_t *, size_t, uint16_t *);
+
+void SumRgbaBlocks(const unsigned char *rgba, size_t stride, size_t blocks, uint16_t *out)
+{
+#if defined(__x86_64__)
+  static const SumRgbaBlocksKernel kernel = __builtin_cpu_supports("avx2") ? SumRgbaBlocksAvx2 : SumRgbaBlocksPortable;
+#else
+  static const SumRgbaBlocksKernel kernel = SumRgbaBlocksPortable;
+#endif
+  kernel(rgba, stride, blocks, out);
+}
+
+void SumBlockPairs(const uint16_t *row0, const uint16_t *row1, size_t blocks, uint16_t *out)
+{
+#if defined(__x86_64__)
+  static const SumBlockPairsKernel kernel = __builtin_cpu_supports("avx2") ? SumBlockPairsAvx2 : SumBlockPairsPortable;
+#else
+  static const SumBlockPairsKernel kernel = SumBlockPairsPortable;
+#endif
+  kernel(row0, row1, blocks, out);
+}
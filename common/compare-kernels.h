@@ -0,0 +1,50 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+
+// Running totals for a pixel-by-pixel comparison of two RGBA8 buffers. Only
+// the colour channels are accumulated: raylib always captures opaque frames
+// and ImageMagick's default channel set for RMSE leaves alpha out as well.
+struct DifferenceAccumulator
+{
+  uint64_t sum_squares = 0;
+  uint64_t pixel_count = 0;
+  uint64_t differing_pixels = 0;
+  int max_difference = 0;
+
+  void Merge(const DifferenceAccumulator& other);
+  double Rmse() const;
+};
+
+void AccumulateDifference(const unsigned char *a, const unsigned char *b, size_t pixel_count, DifferenceAccumulator *acc);
+
+// First and second order moments of a 4x4 luma block pair, as used by SSIM.
+struct BlockMoments
+{
+  int32_t sum_a;
+  int32_t sum_b;
+  int32_t sum_squares;
+  int32_t sum_products;
+};
+
+// Fills `blocks` moments from the 4 luma rows starting at `a` and `b`.
+void AccumulateBlockMoments(const unsigned char *a, const unsigned char *b, size_t stride, size_t blocks, BlockMoments *out);
+
+// Per channel sums of 4x4 RGBA8 blocks, from the 4 rows starting at `rgba`.
+void SumRgbaBlocks(const unsigned char *rgba, size_t stride, size_t blocks, uint16_t *out);
+// Sums 2x2 groups of RGBA block sums from two rows into the next level up.
+// 16 bit lanes hold the sums of up to 16x16 pixels.
+void SumBlockPairs(const uint16_t *row0, const uint16_t *row1, size_t blocks, uint16_t *out);
+
+// 64 bit hash of a `width` x `height` RGBA8 region. The AVX2 and scalar
+// paths produce identical values so hashes can be stored on disk.
+uint64_t HashPixels(const unsigned char *pixels, size_t stride, int width, int height);
+uint64_t HashBytes(const unsigned char *data, size_t size);
+
+// The portable kernels the ones above fall back to without SIMD. Every SIMD
+// path must give exactly the same results, which the kernel tests check.
+void AccumulateDifferencePortable(const unsigned char *a, const unsigned char *b, size_t pixel_count, DifferenceAccumulator *acc);
+void AccumulateBlockMomentsPortable(const unsigned char *a, const unsigned char *b, size_t stride, size_t blocks, BlockMoments *out);
+void SumRgbaBlocksPortable(const unsigned char *rgba, size_t stride, size_t blocks, uint16_t *out);
+void SumBlockPairsPortable(const uint16_t *row0, const uint16_t *row1, size_t blocks, uint16_t *out);
+uint64_t HashPixelsPortable(const unsigned char *pixels, size_t stride, int width, int height);
@@ -0,0 +1,94 @@
+#include <algorithm>
+#include <cmath>
+#include "compare-mask.h"
+#include "image-compare.h"
+
+CompareMask::CompareMask() : width(0), height(0), compared_pixels(0), row_start(1, 0) {}
+
+int CompareMask::Width() const { return width; }
+int CompareMask::Height() const { return height; }
+size_t CompareMask::ComparedPixels() const { return compared_pixels; }
+
+void CompareMask::AddRow(const std::vector<bool>& compared)
+{
+  int x = 0;
+
+  while (x < width)
+  {
+    while (x < width && !compared[x]) x++;
+    if (x == width) break;
+
+    const int begin = x;
+    while (x < width && compared[x]) x++;
+
+    spans.push_back({ begin, x });
+    compared_pixels += x - begin;
+  }
+
+  row_start.push_back(spans.size());
+  height++;
+}
+
+bool CompareMask::IsCompared(int x, int y) const
+{
+  for (size_t i = row_start[y]; i < row_start[y + 1]; ++i)
+    if (x >= spans[i].begin && x < spans[i].end) return true;
+
+  return false;
+}
+
+CompareMask CompareMask::FromRectangles(int width, int height, const std::vector<Rectangle>& ignored)
+{
+  CompareMask mask;
+  mask.width = width;
+
+  std::vector<bool> compared(width);
+
+  for (int y = 0; y < height; ++y)
+  {
+    std::fill(compared.begin(), compared.end(), true);
+
+    for (const auto& rect : ignored)
+    {
+      if (y < std::floor(rect.y) || y >= std::ceil(rect.y + rect.height)) continue;
+
+      const int begin = std::clamp((int)std::floor(rect.x), 0, width);
+      const int end = std::clamp((int)std::ceil(rect.x + rect.width), 0, width);
+      std::fill(compared.begin() + begin, compared.begin() + end, false);
+    }
+
+    mask.AddRow(compared);
+  }
+
+  return mask;
+}
+
+CompareMask CompareMask::FromImage(const DecodedImage& image)
+{
+  CompareMask mask;
+  if (!image.Valid()) return mask;
+
+  mask.width = image.Width();
+
+  std::vector<bool> compared(mask.width);
+
+  for (int y = 0; y < image.Height(); ++y)
+  {
+    const unsigned char *row = image.Pixels() + (size_t)y * image.Width() * 4;
+
+    for (int x = 0; x < mask.width; ++x)
+      compared[x] = row[x * 4] != 0 || row[x * 4 + 1] != 0 || row[x * 4 + 2] != 0;
+
+    mask.AddRow(compared);
+  }
+
+  return mask;
+}
+
+std::string CompareMaskPath(const std::string& golden_path)
+{
+  auto extension = golden_path.rfind(".png");
+  auto base = extension == std::string::npos ? golden_path : golden_path.substr(0, extension);
+
+  return base + ".mask.png";
+}
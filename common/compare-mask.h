@@ -0,0 +1,60 @@
+#pragma once
+#include <algorithm>
+#include <cstddef>
+#include <string>
+#include <vector>
+
+extern "C"
+{
+  #include <raylib.h>
+}
+
+class DecodedImage;
+
+struct Span
+{
+  int begin;
+  int end;
+};
+
+// Pixels of a golden that comparisons must ignore, e.g. an FPS counter.
+// It is stored as the spans of *compared* pixels on each row, so kernels
+// walk the spans and never load masked pixels at all.
+class CompareMask
+{
+  public:
+    CompareMask();
+
+    static CompareMask FromRectangles(int width, int height, const std::vector<Rectangle>& ignored);
+    // Black pixels of `mask` are ignored, any other colour is compared.
+    static CompareMask FromImage(const DecodedImage& mask);
+
+    int Width() const;
+    int Height() const;
+    size_t ComparedPixels() const;
+
+    // Spans of compared pixels on row `y`, clipped to [x_begin, x_end).
+    template <class F>
+    void ForEachSpan(int y, int x_begin, int x_end, F fn) const
+    {
+      for (size_t i = row_start[y]; i < row_start[y + 1]; ++i)
+      {
+        const int begin = std::max(spans[i].begin, x_begin);
+        const int end = std::min(spans[i].end, x_end);
+        if (begin < end) fn(begin, end);
+      }
+    }
+
+    bool IsCompared(int x, int y) const;
+
+  private:
+    void AddRow(const std::vector<bool>& compared);
+
+    int width;
+    int height;
+    size_t compared_pixels;
+    std::vector<Span> spans;
+    std::vector<size_t> row_start;
+};
+
+std::string CompareMaskPath(const std::string& golden_path);
@@ -0,0 +1,40 @@
+#version 330
+
+// Input uniform values
+uniform sampler2D texture0;     // Frame copied from the framebuffer, bottom row first
+uniform sampler2D texture1;     // Golden image, top row first
+uniform ivec2 size;             // Size of both images
+
+// Output fragment color
+out vec4 finalColor;
+
+// Every output texel covers a 4x4 block of pixels and holds the sum of their
+// squared channel differences, in 0-255 units, as three base 256 digits:
+// r the high one, b the low one. The sum stays below 2^22, so it is exact in
+// a float, and the digits let the reduction add them up exactly for longer.
+void main()
+{
+    ivec2 origin = ivec2(gl_FragCoord.xy)*4;
+    float sum = 0.0;
+
+    for (int y = 0; y < 4; y++)
+    {
+        for (int x = 0; x < 4; x++)
+        {
+            ivec2 p = origin + ivec2(x, y);
+            if (p.x >= size.x || p.y >= size.y) continue;
+
+            vec3 frame = texelFetch(texture0, p, 0).rgb;
+            vec3 golden = texelFetch(texture1, ivec2(p.x, size.y - 1 - p.y), 0).rgb;
+            vec3 d = floor(frame*255.0 + 0.5) - floor(golden*255.0 + 0.5);
+
+            sum += dot(d, d);
+        }
+    }
+
+    float high = floor(sum/65536.0);
+    float middle = floor((sum - high*65536.0)/256.0);
+    float low = sum - high*65536.0 - middle*256.0;
+
+    finalColor = vec4(high, middle, low, 1.0);
+}
@@ -0,0 +1,79 @@
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include "failure-report.h"
+#include "image-compare.h"
+#include "thread-pool.h"
+
+constexpr int SPACER_WIDTH = 1;
+
+static void HeatMapPixel(const unsigned char *golden, const unsigned char *candidate, unsigned char *out)
+{
+  int difference = 0;
+  for (int c = 0; c < 3; ++c)
+    difference = std::max(difference, std::abs((int)golden[c] - (int)candidate[c]));
+
+  if (difference == 0)
+  {
+    const unsigned char dimmed = (77 * golden[0] + 150 * golden[1] + 29 * golden[2]) >> 10;
+    out[0] = out[1] = out[2] = dimmed;
+  }
+  else
+  {
+    out[0] = 255;
+    out[1] = (unsigned char)std::min(255, difference * 2);
+    out[2] = 0;
+  }
+
+  out[3] = 255;
+}
+
+static void CopyRow(const DecodedImage& image, int y, unsigned char *out)
+{
+  if (y >= image.Height()) return;
+  std::memcpy(out, image.Pixels() + (size_t)y * image.Width() * 4, (size_t)image.Width() * 4);
+}
+
+bool WriteFailureArtifact(const DecodedImage& golden, const DecodedImage& candidate, const std::string& path)
+{
+  if (!golden.Valid() || !candidate.Valid()) return false;
+
+  const int heat_width = std::min(golden.Width(), candidate.Width());
+  const int heat_height = std::min(golden.Height(), candidate.Height());
+  const int width = golden.Width() + SPACER_WIDTH + candidate.Width() + SPACER_WIDTH + heat_width;
+  const int height = std::max(golden.Height(), candidate.Height());
+  const size_t stride = (size_t)width * 4;
+
+  Image composed = { 0 };
+  composed.data = MemAlloc(stride * height);
+  composed.width = width;
+  composed.height = height;
+  composed.mipmaps = 1;
+  composed.format = PIXELFORMAT_UNCOMPRESSED_R8G8B8A8;
+
+  DecodedImage artifact(composed);
+  unsigned char *pixels = (unsigned char *)composed.data;
+
+  DefaultThreadPool().ParallelFor(height, [&](size_t y) {
+    unsigned char *row = pixels + y * stride;
+
+    // MemAlloc zeroes memory, so spacers and padding only need opaque alpha
+    for (int x = 0; x < width; ++x) row[x * 4 + 3] = 255;
+
+    CopyRow(golden, y, row);
+    row += (size_t)(golden.Width() + SPACER_WIDTH) * 4;
+
+    CopyRow(candidate, y, row);
+    row += (size_t)(candidate.Width() + SPACER_WIDTH) * 4;
+
+    if ((int)y >= heat_height) return;
+
+    const unsigned char *g = golden.Pixels() + y * golden.Width() * 4;
+    const unsigned char *c = candidate.Pixels() + y * candidate.Width() * 4;
+
+    for (int x = 0; x < heat_width; ++x)
+      HeatMapPixel(g + x * 4, c + x * 4, row + x * 4);
+  });
+
+  return artifact.Export(path);
+}
@@ -0,0 +1,9 @@
+#pragma once
+#include <string>
+
+class DecodedImage;
+
+// Writes golden | spacer | candidate | heat map side by side to `path`. In
+// the heat map, matching pixels are a dimmed copy of the golden and
+// differing pixels go from red to yellow with the size of the difference.
+bool WriteFailureArtifact(const DecodedImage& golden, const DecodedImage& candidate, const std::string& path);
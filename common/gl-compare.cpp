@@ -0,0 +1,216 @@
+extern "C"
+{
+  #include <raylib.h>
+  #include <rlgl.h>
+}
+#include <GL/gl.h>
+#include <cstdint>
+#include <filesystem>
+#include <string>
+#include <system_error>
+#include <vector>
+#include "gl-compare.h"
+#include "render.h"
+
+constexpr const char *DIFF_SHADER = "common/diff.fs";
+constexpr const char *REDUCE_SHADER = "common/reduce.fs";
+constexpr int REDUCTION_FACTOR = 4;
+// Each level sums the digits of 16 texels of the previous one. A digit is at
+// most 255 and floats count exactly up to 2^24, so sums of 16^4 blocks are
+// still exact: the reduction stops there and the CPU adds up what is left.
+constexpr size_t MAX_LEVELS = 5;
+
+// Everything a comparison needs on the GPU. Shaders and targets only depend
+// on the screen size and the golden texture on the golden file, so
+// consecutive comparisons reuse them until CleanUp() releases them.
+struct GpuResources
+{
+  Shader diff = { 0 };
+  Shader reduce = { 0 };
+  int width = 0;
+  int height = 0;
+  RenderTexture2D frame = { 0 };
+  std::vector<RenderTexture2D> levels;
+  std::string golden_path;
+  std::filesystem::file_time_type golden_modified;
+  Texture2D golden_texture = { 0 };
+};
+
+static GpuResources gpu;
+static bool release_registered = false;
+
+static void ReleaseTargets()
+{
+  if (gpu.frame.id != 0) UnloadRenderTexture(gpu.frame);
+  for (const auto& level : gpu.levels) UnloadRenderTexture(level);
+
+  gpu.frame = { 0 };
+  gpu.levels.clear();
+  gpu.width = 0;
+  gpu.height = 0;
+}
+
+static void ReleaseGolden()
+{
+  if (gpu.golden_texture.id != 0) UnloadTexture(gpu.golden_texture);
+
+  gpu.golden_texture = { 0 };
+  gpu.golden_path.clear();
+}
+
+static void ReleaseGpuResources()
+{
+  ReleaseGolden();
+  ReleaseTargets();
+  if (gpu.diff.id != 0) UnloadShader(gpu.diff);
+  if (gpu.reduce.id != 0) UnloadShader(gpu.reduce);
+
+  gpu = GpuResources();
+  release_registered = false;
+}
+
+static RenderTexture2D LoadFloatTarget(int width, int height)
+{
+  RenderTexture2D target = { 0 };
+
+  target.id = rlLoadFramebuffer();
+  if (target.id == 0) return target;
+
+  target.texture.id = rlLoadTexture(nullptr, width, height, PIXELFORMAT_UNCOMPRESSED_R32G32B32A32, 1);
+  target.texture.width = width;
+  target.texture.height = height;
+  target.texture.mipmaps = 1;
+  target.texture.format = PIXELFORMAT_UNCOMPRESSED_R32G32B32A32;
+
+  rlFramebufferAttach(target.id, target.texture.id, RL_ATTACHMENT_COLOR_CHANNEL0, RL_ATTACHMENT_TEXTURE2D, 0);
+
+  if (!rlFramebufferComplete(target.id))
+  {
+    UnloadRenderTexture(target);
+    target = { 0 };
+  }
+
+  return target;
+}
+
+// Draws `source` through `shader` into `target`, one fragment per output
+// texel. `second` is bound as texture1 when given.
+static void RunPass(Shader shader, Texture2D source, RenderTexture2D target, const Texture2D *second = nullptr)
+{
+  const int size[2] = { source.width, source.height };
+
+  BeginTextureMode(target);
+  ClearBackground(BLANK);
+  BeginShaderMode(shader);
+  SetShaderValue(shader, GetShaderLocation(shader, "size"), size, SHADER_UNIFORM_IVEC2);
+  if (second != nullptr) SetShaderValueTexture(shader, GetShaderLocation(shader, "texture1"), *second);
+  DrawTexturePro(source, { 0, 0, (float)source.width, (float)source.height },
+                 { 0, 0, (float)target.texture.width, (float)target.texture.height }, { 0, 0 }, 0.f, WHITE);
+  EndShaderMode();
+  EndTextureMode();
+}
+
+static bool PrepareShaders()
+{
+  if (gpu.diff.id == 0) gpu.diff = LoadShader(nullptr, DIFF_SHADER);
+  if (gpu.reduce.id == 0) gpu.reduce = LoadShader(nullptr, REDUCE_SHADER);
+
+  // raylib falls back to its default shader when one fails to compile
+  return gpu.diff.id != rlGetShaderIdDefault() && gpu.reduce.id != rlGetShaderIdDefault();
+}
+
+static bool PrepareTargets(int width, int height)
+{
+  if (gpu.width != width || gpu.height != height)
+  {
+    ReleaseTargets();
+
+    gpu.width = width;
+    gpu.height = height;
+    gpu.frame = LoadRenderTexture(width, height);
+
+    for (int w = width, h = height; gpu.levels.empty() || ((w > 1 || h > 1) && gpu.levels.size() < MAX_LEVELS);)
+    {
+      w = (w + REDUCTION_FACTOR - 1) / REDUCTION_FACTOR;
+      h = (h + REDUCTION_FACTOR - 1) / REDUCTION_FACTOR;
+      gpu.levels.push_back(LoadFloatTarget(w, h));
+    }
+  }
+
+  bool ready = gpu.frame.id != 0;
+  for (const auto& level : gpu.levels) ready &= level.id != 0;
+
+  return ready;
+}
+
+static bool PrepareGolden(const std::string& golden_path, int width, int height)
+{
+  std::error_code error;
+  auto modified = std::filesystem::last_write_time(golden_path, error);
+  if (error) return false;
+
+  if (gpu.golden_texture.id != 0 && gpu.golden_path == golden_path && gpu.golden_modified == modified) return true;
+
+  auto golden = DefaultComparator().Golden(golden_path);
+  if (golden == nullptr || golden->Width() != width || golden->Height() != height) return false;
+
+  // Goldens of one suite share the screen size, so the texture is updated in place
+  if (gpu.golden_texture.id != 0 && gpu.golden_texture.width == width && gpu.golden_texture.height == height)
+    UpdateTexture(gpu.golden_texture, golden->Pixels());
+  else
+  {
+    ReleaseGolden();
+
+    Image golden_image = { (void *)golden->Pixels(), width, height, 1, PIXELFORMAT_UNCOMPRESSED_R8G8B8A8 };
+    gpu.golden_texture = LoadTextureFromImage(golden_image);
+    if (gpu.golden_texture.id == 0) return false;
+  }
+
+  gpu.golden_path = golden_path;
+  gpu.golden_modified = modified;
+  return true;
+}
+
+bool CompareScreenOnGpu(const std::string& golden_path, const CompareOptions& options, bool *different, double *value)
+{
+  if (options.metric != Metric::Rmse && options.metric != Metric::Psnr) return false;
+
+  const int width = GetRenderWidth();
+  const int height = GetRenderHeight();
+
+  if (!release_registered)
+  {
+    AtCleanUp(ReleaseGpuResources);
+    release_registered = true;
+  }
+
+  if (!PrepareShaders() || !PrepareTargets(width, height) || !PrepareGolden(golden_path, width, height)) return false;
+
+  // Copy the framebuffer as it is, so no pixel leaves the GPU
+  rlBindFramebuffer(RL_READ_FRAMEBUFFER, 0);
+  rlBindFramebuffer(RL_DRAW_FRAMEBUFFER, gpu.frame.id);
+  rlBlitFramebuffer(0, 0, width, height, 0, 0, width, height, GL_COLOR_BUFFER_BIT);
+  rlDisableFramebuffer();
+
+  RunPass(gpu.diff, gpu.frame.texture, gpu.levels[0], &gpu.golden_texture);
+
+  for (size_t i = 1; i < gpu.levels.size(); ++i)
+    RunPass(gpu.reduce, gpu.levels[i - 1].texture, gpu.levels[i]);
+
+  const Texture2D& last = gpu.levels.back().texture;
+  float *pixels = (float *)rlReadTexturePixels(last.id, last.width, last.height, PIXELFORMAT_UNCOMPRESSED_R32G32B32A32);
+  if (pixels == nullptr) return false;
+
+  uint64_t sum_squares = 0;
+  for (size_t i = 0; i < (size_t)last.width * last.height; ++i)
+  {
+    const float *digits = pixels + i * 4;
+    sum_squares += (uint64_t)digits[0] * 65536 + (uint64_t)digits[1] * 256 + (uint64_t)digits[2];
+  }
+
+  MemFree(pixels);
+
+  *value = ValueFromSumOfSquares(options.metric, sum_squares, (size_t)width * height);
+  *different = ExceedsThreshold(options, *value);
+  return true;
+}
@@ -0,0 +1,20 @@
+#pragma once
+#include <string>
+#include "image-compare.h"
+
+// Compares the frame currently on screen against the golden at `golden_path`
+// without reading the frame back. The frame is blitted into a texture,
+// common/diff.fs sums squared differences per 4x4 block against the golden
+// uploaded as a texture, and common/reduce.fs folds the blocks 4x4 at a time
+// as long as float sums stay exact. The few texels left are read back and
+// added up on the CPU, so the value is exactly the one the CPU backend gets.
+//
+// Shaders, targets and the golden texture stay on the GPU between calls and
+// are only rebuilt when the screen size or the golden file changes.
+// CleanUp() releases them.
+//
+// Must be called with a live GL context, after EndDrawing(). Returns false
+// without a verdict when the comparison can't run on the GPU: metrics other
+// than RMSE and PSNR, a missing golden or one of a different size than the
+// screen, or a driver without float render targets.
+bool CompareScreenOnGpu(const std::string& golden_path, const CompareOptions& options, bool *different, double *value);
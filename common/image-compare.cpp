@@ -1,40 +1,824 @@
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstring>
+#include <limits>
 #include <string>
-extern "C"
+#include <system_error>
+#include <vector>
+#include "image-compare.h"
+#include "capture-pool.h"
+#include "compare-kernels.h"
+#include "pixel-convert.h"
+#include "png-stream.h"
+#include "thread-pool.h"
+
+DecodedImage::DecodedImage() : image({ 0 }), storage(Storage::Raylib) {}
+
+DecodedImage::DecodedImage(Image image) : image(image), storage(Storage::Raylib) {}
+
+DecodedImage::DecodedImage(DecodedImage&& other) : image(other.image), storage(other.storage)
 {
-  #include <wand/MagickWand.h>
+  other.image = { 0 };
 }
 
-bool AreImagesDifferent(const std::string& path1, const std::string& path2, double *distortion) {
-  MagickWand *img1 = NULL, *img2 = NULL, *diff = NULL;
+DecodedImage& DecodedImage::operator=(DecodedImage&& other)
+{
+  if (this != &other)
+  {
+    Release();
+    image = other.image;
+    storage = other.storage;
+    other.image = { 0 };
+  }
+
+  return *this;
+}
+
+DecodedImage::~DecodedImage()
+{
+  Release();
+}
 
-  MagickWandGenesis();
+void DecodedImage::Release()
+{
+  switch (storage)
+  {
+    case Storage::Raylib: UnloadImage(image); break;
+    case Storage::Pool: DefaultCapturePool().Release((unsigned char *)image.data); break;
+    case Storage::View: break;
+  }
+}
 
-  img1 = NewMagickWand();
-  img2 = NewMagickWand();
+DecodedImage DecodedImage::Load(const std::string& path)
+{
+  Image image = LoadImage(path.c_str());
+  if (image.data == nullptr) return DecodedImage();
+
+  if (image.format == PIXELFORMAT_UNCOMPRESSED_R8G8B8)
+  {
+    unsigned char *rgba = (unsigned char *)MemAlloc((unsigned int)((size_t)image.width * image.height * 4));
+    ConvertPixels<PixelLayout::Rgb, PixelLayout::Rgba>((const unsigned char *)image.data, rgba, (size_t)image.width * image.height);
 
-  if (MagickReadImage(img1, path1.c_str()) == MagickFalse ||
-      MagickReadImage(img2, path2.c_str()) == MagickFalse) {
-        if (img1) DestroyMagickWand(img1);
-        if (img2) DestroyMagickWand(img2);
-        MagickWandTerminus();
-        return true;
+    MemFree(image.data);
+    image.data = rgba;
+    image.format = PIXELFORMAT_UNCOMPRESSED_R8G8B8A8;
   }
+  else ImageFormat(&image, PIXELFORMAT_UNCOMPRESSED_R8G8B8A8);
 
-  if (MagickGetImageWidth(img1) != MagickGetImageWidth(img2) ||
-      MagickGetImageHeight(img1) != MagickGetImageHeight(img2)) {
-      if (img1) DestroyMagickWand(img1);
-      if (img2) DestroyMagickWand(img2);
-      MagickWandTerminus();
-      return true;
+  return DecodedImage(image);
+}
+
+DecodedImage DecodedImage::View(const unsigned char *pixels, int width, int height)
+{
+  Image image = { (void *)pixels, width, height, 1, PIXELFORMAT_UNCOMPRESSED_R8G8B8A8 };
+
+  DecodedImage view(image);
+  view.storage = Storage::View;
+  return view;
+}
+
+DecodedImage DecodedImage::Pooled(unsigned char *pixels, int width, int height)
+{
+  Image image = { pixels, width, height, 1, PIXELFORMAT_UNCOMPRESSED_R8G8B8A8 };
+
+  DecodedImage pooled(image);
+  pooled.storage = Storage::Pool;
+  return pooled;
+}
+
+bool DecodedImage::Export(const std::string& path) const
+{
+  if (!Valid()) return false;
+  if (storage != Storage::Pool) return ExportImage(image, path.c_str());
+
+  // Screen captures are always opaque, so their alpha isn't worth encoding
+  std::vector<unsigned char> rgb(PixelCount() * 3);
+  ConvertPixels<PixelLayout::Rgba, PixelLayout::Rgb>(Pixels(), rgb.data(), PixelCount());
+
+  Image opaque = { rgb.data(), image.width, image.height, 1, PIXELFORMAT_UNCOMPRESSED_R8G8B8 };
+  return ExportImage(opaque, path.c_str());
+}
+
+bool DecodedImage::Valid() const { return image.data != nullptr; }
+int DecodedImage::Width() const { return image.width; }
+int DecodedImage::Height() const { return image.height; }
+size_t DecodedImage::PixelCount() const { return (size_t)image.width * image.height; }
+size_t DecodedImage::SizeInBytes() const { return PixelCount() * 4; }
+const unsigned char *DecodedImage::Pixels() const { return (const unsigned char *)image.data; }
+
+Comparator::Comparator(size_t capacity_bytes) : capacity_bytes(capacity_bytes), cached_bytes(0) {}
+
+std::shared_ptr<const DecodedImage> Comparator::Golden(const std::string& path)
+{
+  std::error_code error;
+  auto modified = std::filesystem::last_write_time(path, error);
+  if (error) return nullptr;
+
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+
+    auto cached = goldens.find(path);
+    if (cached != goldens.end() && cached->second.modified == modified)
+    {
+      recently_used.splice(recently_used.begin(), recently_used, cached->second.recency);
+      return cached->second.image;
+    }
+  }
+
+  // Decode without holding the lock so other threads keep comparing
+  auto image = std::make_shared<const DecodedImage>(DecodedImage::Load(path));
+  if (!image->Valid()) return nullptr;
+
+  std::lock_guard<std::mutex> lock(mutex);
+
+  ForgetLocked(path);
+  EvictUntilFits(image->SizeInBytes());
+  cached_bytes += image->SizeInBytes();
+  recently_used.push_front(path);
+
+  auto& entry = goldens[path];
+  entry.image = image;
+  entry.modified = modified;
+  entry.recency = recently_used.begin();
+
+  return image;
+}
+
+std::shared_ptr<const SumPyramid> Comparator::GoldenPyramid(const std::string& path)
+{
+  auto golden = Golden(path);
+  if (golden == nullptr) return nullptr;
+
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+
+    auto cached = goldens.find(path);
+    if (cached != goldens.end() && cached->second.image == golden && cached->second.pyramid != nullptr)
+      return cached->second.pyramid;
+  }
+
+  auto pyramid = std::make_shared<const SumPyramid>(BuildSumPyramid(*golden));
+
+  std::lock_guard<std::mutex> lock(mutex);
+
+  auto cached = goldens.find(path);
+  if (cached != goldens.end() && cached->second.image == golden) cached->second.pyramid = pyramid;
+
+  return pyramid;
+}
+
+void Comparator::Forget(const std::string& path)
+{
+  std::lock_guard<std::mutex> lock(mutex);
+  ForgetLocked(path);
+}
+
+void Comparator::ForgetLocked(const std::string& path)
+{
+  auto cached = goldens.find(path);
+  if (cached == goldens.end()) return;
+
+  cached_bytes -= cached->second.image->SizeInBytes();
+  recently_used.erase(cached->second.recency);
+  goldens.erase(cached);
+}
+
+void Comparator::Clear()
+{
+  std::lock_guard<std::mutex> lock(mutex);
+
+  manifests.clear();
+  masks.clear();
+  goldens.clear();
+  recently_used.clear();
+  cached_bytes = 0;
+}
+
+void Comparator::EvictUntilFits(size_t bytes)
+{
+  while (!recently_used.empty() && cached_bytes + bytes > capacity_bytes)
+    ForgetLocked(recently_used.back());
+}
+
+std::shared_ptr<const TileManifest> Comparator::Manifest(const std::string& golden_path)
+{
+  std::error_code error;
+  auto modified = std::filesystem::last_write_time(golden_path, error);
+  if (error) return nullptr;
+
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+
+    auto cached = manifests.find(golden_path);
+    if (cached != manifests.end() && cached->second.modified == modified)
+      return cached->second.manifest;
+  }
+
+  // Missing and stale manifests are not rebuilt here, that would decode the
+  // golden for a comparison that has to decode it anyway
+  auto manifest = std::make_shared<TileManifest>();
+  if (!LoadTileManifest(golden_path, manifest.get())) return nullptr;
+
+  std::lock_guard<std::mutex> lock(mutex);
+
+  auto& entry = manifests[golden_path];
+  entry.manifest = manifest;
+  entry.modified = modified;
+
+  return manifest;
+}
+
+void Comparator::SetMask(const std::string& golden_path, CompareMask mask)
+{
+  std::lock_guard<std::mutex> lock(mutex);
+  masks[golden_path] = std::make_shared<const CompareMask>(std::move(mask));
+}
+
+void Comparator::ResetMask(const std::string& golden_path)
+{
+  std::lock_guard<std::mutex> lock(mutex);
+  masks.erase(golden_path);
+}
+
+std::shared_ptr<const CompareMask> Comparator::Mask(const std::string& golden_path)
+{
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+
+    auto cached = masks.find(golden_path);
+    if (cached != masks.end()) return cached->second;
   }
 
-  *distortion = 0.0;
-  if (MagickCompareImages(img1, img2, RootMeanSquaredErrorMetric, distortion) == nullptr) {
-    if (img1) DestroyMagickWand(img1);
-    if (img2) DestroyMagickWand(img2);
-    MagickWandTerminus();
+  std::shared_ptr<const CompareMask> mask;
+
+  const auto mask_path = CompareMaskPath(golden_path);
+  if (std::filesystem::exists(mask_path))
+  {
+    auto image = DecodedImage::Load(mask_path);
+    if (image.Valid()) mask = std::make_shared<const CompareMask>(CompareMask::FromImage(image));
+  }
+
+  std::lock_guard<std::mutex> lock(mutex);
+
+  // An explicit SetMask() from another thread wins over the sidecar image
+  auto cached = masks.emplace(golden_path, mask).first;
+  return cached->second;
+}
+
+// Block sums only bound tiles whose pixels are all compared
+static bool IsFullyCompared(const CompareMask& mask, const Tile& tile)
+{
+  int compared = 0;
+
+  for (int y = tile.y; y < tile.y + tile.height; ++y)
+    mask.ForEachSpan(y, tile.x, tile.x + tile.width, [&](int begin, int end) { compared += end - begin; });
+
+  return compared == tile.width * tile.height;
+}
+
+bool Comparator::IsDifferentFromGolden(const std::string& golden_path, const DecodedImage& candidate, const CompareOptions& options, double *value)
+{
+  const bool verdict_only = value == nullptr;
+  double unreported = 0.0;
+  if (verdict_only) value = &unreported;
+
+  auto manifest = Manifest(golden_path);
+
+  if (!candidate.Valid() || (manifest != nullptr &&
+      (manifest->width != candidate.Width() || manifest->height != candidate.Height()))) {
     return true;
   }
 
-  return *distortion != 0.0;
+  auto mask = Mask(golden_path);
+  if (mask != nullptr && (mask->Width() != candidate.Width() || mask->Height() != candidate.Height()))
+    mask = nullptr;
+
+  // Without a manifest every tile has to be measured
+  const auto tiles = SplitIntoTiles(candidate.Width(), candidate.Height());
+  std::vector<Tile> mismatching;
+
+  if (manifest == nullptr) mismatching = tiles;
+  else
+  {
+    const auto hashes = HashTiles(candidate.Pixels(), candidate.Width(), candidate.Height());
+
+    for (size_t i = 0; i < tiles.size(); ++i)
+      if (hashes[i] != manifest->tile_hashes[i]) mismatching.push_back(tiles[i]);
+  }
+
+  if (mismatching.empty())
+  {
+    *value = IdenticalValue(options.metric);
+    return ExceedsThreshold(options, *value);
+  }
+
+  bool cached = false;
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    cached = goldens.count(golden_path) > 0;
+  }
+
+  // Without a decoded golden at hand, decode it row by row and stop once
+  // the verdict is known instead of decoding it whole. That leaves a failing
+  // value at the bound reached so far, so it is only done for the verdict.
+  bool different = true;
+  if (verdict_only && !cached && CompareStreaming(golden_path, candidate, options, mask.get(), &different, value))
+    return different;
+
+  auto golden = Golden(golden_path);
+
+  if (golden == nullptr ||
+      golden->Width() != candidate.Width() ||
+      golden->Height() != candidate.Height()) {
+    return true;
+  }
+
+  // The pyramid only proves failures, so it is of no use when the exact
+  // value has to be reported anyway. Exact comparisons fail on any
+  // difference, so it only helps thresholded ones.
+  if (verdict_only && options.threshold > 0 && (options.metric == Metric::Rmse || options.metric == Metric::Psnr))
+  {
+    std::vector<Tile> bounded;
+    for (const auto& tile : mismatching)
+      if (mask == nullptr || IsFullyCompared(*mask, tile)) bounded.push_back(tile);
+
+    auto golden_pyramid = bounded.empty() ? nullptr : GoldenPyramid(golden_path);
+    const size_t compared = mask ? mask->ComparedPixels() : candidate.PixelCount();
+
+    if (golden_pyramid != nullptr && FailsOnPyramid(*golden_pyramid, BuildSumPyramid(candidate, bounded), bounded, options, compared))
+      return true;
+  }
+
+  *value = MeasureDifferenceInTiles(options.metric, *golden, candidate, mismatching, mask.get());
+  return ExceedsThreshold(options, *value);
+}
+
+bool Comparator::AreImagesDifferent(const std::string& golden_path, const std::string& candidate_path, double *distortion)
+{
+  auto candidate = DecodedImage::Load(candidate_path);
+
+  return IsDifferentFromGolden(golden_path, candidate, CompareOptions(), distortion);
+}
+
+Comparator& DefaultComparator()
+{
+  static Comparator comparator;
+  return comparator;
+}
+
+DifferenceStats ComparePixels(const unsigned char *a, const unsigned char *b, size_t pixel_count)
+{
+  DifferenceAccumulator acc;
+  AccumulateDifference(a, b, pixel_count, &acc);
+
+  return { acc.Rmse(), acc.max_difference, (size_t)acc.differing_pixels };
+}
+
+std::vector<Tile> SplitIntoTiles(int width, int height)
+{
+  std::vector<Tile> tiles;
+
+  for (int y = 0; y < height; y += TILE_SIZE)
+    for (int x = 0; x < width; x += TILE_SIZE)
+      tiles.push_back({ x, y, std::min(TILE_SIZE, width - x), std::min(TILE_SIZE, height - y) });
+
+  return tiles;
+}
+
+static DifferenceAccumulator AccumulateTiles(const DecodedImage& a, const DecodedImage& b, const std::vector<Tile>& tiles, const CompareMask *mask)
+{
+  const size_t stride = (size_t)a.Width() * 4;
+  std::vector<DifferenceAccumulator> partial(tiles.size());
+
+  DefaultThreadPool().ParallelFor(tiles.size(), [&](size_t i) {
+    const auto& tile = tiles[i];
+
+    for (int y = tile.y; y < tile.y + tile.height; ++y)
+    {
+      const size_t row = y * stride;
+
+      if (mask == nullptr)
+      {
+        AccumulateDifference(a.Pixels() + row + (size_t)tile.x * 4, b.Pixels() + row + (size_t)tile.x * 4, tile.width, &partial[i]);
+        continue;
+      }
+
+      mask->ForEachSpan(y, tile.x, tile.x + tile.width, [&](int begin, int end) {
+        AccumulateDifference(a.Pixels() + row + (size_t)begin * 4, b.Pixels() + row + (size_t)begin * 4, end - begin, &partial[i]);
+      });
+    }
+  });
+
+  DifferenceAccumulator total;
+  for (const auto& acc : partial) total.Merge(acc);
+
+  // Tiles left out are identical, they only count towards the pixel total
+  total.pixel_count = mask ? mask->ComparedPixels() : a.PixelCount();
+
+  return total;
+}
+
+static double Psnr(const DifferenceAccumulator& acc)
+{
+  if (acc.sum_squares == 0) return std::numeric_limits<double>::infinity();
+
+  const double mse = (double)acc.sum_squares / (double)(acc.pixel_count * 3);
+  return 10.0 * std::log10(255.0 * 255.0 / mse);
+}
+
+// x264-style SSIM on luma: 4x4 block moments combined into overlapping 8x8
+// windows with a stride of 4 pixels.
+static double WindowSsim(const BlockMoments& m00, const BlockMoments& m01, const BlockMoments& m10, const BlockMoments& m11)
+{
+  const double c1 = 0.01 * 0.01 * 255 * 255 * 64;
+  const double c2 = 0.03 * 0.03 * 255 * 255 * 64 * 63;
+
+  const double s1 = m00.sum_a + m01.sum_a + m10.sum_a + m11.sum_a;
+  const double s2 = m00.sum_b + m01.sum_b + m10.sum_b + m11.sum_b;
+  const double ss = m00.sum_squares + m01.sum_squares + m10.sum_squares + m11.sum_squares;
+  const double s12 = m00.sum_products + m01.sum_products + m10.sum_products + m11.sum_products;
+
+  const double vars = ss * 64 - s1 * s1 - s2 * s2;
+  const double covar = s12 * 64 - s1 * s2;
+
+  return (2 * s1 * s2 + c1) * (2 * covar + c2) / ((s1 * s1 + s2 * s2 + c1) * (vars + c2));
+}
+
+// Marks the 4x4 blocks of block row `by` whose 16 pixels are all compared.
+static void ComparedBlocks(const CompareMask& mask, int by, std::vector<char> *compared)
+{
+  std::vector<int> covered(compared->size(), 0);
+  const int width = (int)compared->size() * 4;
+
+  for (int y = by * 4; y < by * 4 + 4; ++y)
+  {
+    mask.ForEachSpan(y, 0, width, [&](int begin, int end) {
+      for (int bx = begin / 4; bx * 4 < end; ++bx)
+        covered[bx] += std::min(end, bx * 4 + 4) - std::max(begin, bx * 4);
+    });
+  }
+
+  for (size_t bx = 0; bx < compared->size(); ++bx)
+    (*compared)[bx] = covered[bx] == 16;
+}
+
+// With a mask, only windows made of fully compared blocks contribute and
+// moments are never accumulated for blocks touching an ignored pixel.
+static double Ssim(const DecodedImage& a, const DecodedImage& b, const CompareMask *mask)
+{
+  const int width = a.Width();
+  const int height = a.Height();
+  const int blocks_x = width / 4;
+  const int blocks_y = height / 4;
+
+  if (blocks_x < 2 || blocks_y < 2)
+    return ComparePixels(a.Pixels(), b.Pixels(), a.PixelCount()).differing_pixels == 0 ? 1.0 : 0.0;
+
+  auto& pool = DefaultThreadPool();
+  const int block_rows_per_task = TILE_SIZE / 4;
+  const size_t tasks = (blocks_y + block_rows_per_task - 1) / block_rows_per_task;
+
+  std::vector<unsigned char> luma_a(a.PixelCount());
+  std::vector<unsigned char> luma_b(b.PixelCount());
+
+  pool.ParallelFor((height + TILE_SIZE - 1) / TILE_SIZE, [&](size_t band) {
+    const size_t first = band * TILE_SIZE * width;
+    const size_t count = (size_t)std::min(TILE_SIZE, height - (int)band * TILE_SIZE) * width;
+    ConvertPixels<PixelLayout::Rgba, PixelLayout::Gray>(a.Pixels() + first * 4, luma_a.data() + first, count);
+    ConvertPixels<PixelLayout::Rgba, PixelLayout::Gray>(b.Pixels() + first * 4, luma_b.data() + first, count);
+  });
+
+  std::vector<BlockMoments> moments((size_t)blocks_x * blocks_y);
+  std::vector<char> compared((size_t)blocks_x * blocks_y, 1);
+
+  pool.ParallelFor(tasks, [&](size_t task) {
+    const int last = std::min(blocks_y, (int)(task + 1) * block_rows_per_task);
+    std::vector<char> row_compared(blocks_x);
+
+    for (int by = task * block_rows_per_task; by < last; ++by)
+    {
+      const size_t offset = (size_t)by * 4 * width;
+      BlockMoments *row = &moments[(size_t)by * blocks_x];
+
+      if (mask == nullptr)
+      {
+        AccumulateBlockMoments(luma_a.data() + offset, luma_b.data() + offset, width, blocks_x, row);
+        continue;
+      }
+
+      ComparedBlocks(*mask, by, &row_compared);
+      std::copy(row_compared.begin(), row_compared.end(), compared.begin() + (size_t)by * blocks_x);
+
+      for (int bx = 0; bx < blocks_x;)
+      {
+        if (!row_compared[bx]) { bx++; continue; }
+
+        const int begin = bx;
+        while (bx < blocks_x && row_compared[bx]) bx++;
+
+        AccumulateBlockMoments(luma_a.data() + offset + begin * 4, luma_b.data() + offset + begin * 4, width, bx - begin, row + begin);
+      }
+    }
+  });
+
+  std::vector<double> partial(tasks, 0.0);
+  std::vector<size_t> windows(tasks, 0);
+
+  pool.ParallelFor(tasks, [&](size_t task) {
+    const int last = std::min(blocks_y - 1, (int)(task + 1) * block_rows_per_task);
+
+    for (int by = task * block_rows_per_task; by < last; ++by)
+    {
+      const BlockMoments *row = &moments[(size_t)by * blocks_x];
+      const BlockMoments *next = row + blocks_x;
+      const char *row_compared = &compared[(size_t)by * blocks_x];
+      const char *next_compared = row_compared + blocks_x;
+
+      for (int bx = 0; bx < blocks_x - 1; ++bx)
+      {
+        if (!(row_compared[bx] && row_compared[bx + 1] && next_compared[bx] && next_compared[bx + 1])) continue;
+
+        partial[task] += WindowSsim(row[bx], row[bx + 1], next[bx], next[bx + 1]);
+        windows[task]++;
+      }
+    }
+  });
+
+  double total = 0.0;
+  size_t total_windows = 0;
+
+  for (size_t task = 0; task < tasks; ++task)
+  {
+    total += partial[task];
+    total_windows += windows[task];
+  }
+
+  return total_windows == 0 ? 1.0 : total / (double)total_windows;
+}
+
+static void RgbToLab(const unsigned char *rgb, float *lab)
+{
+  static const auto linear = []() {
+    std::array<float, 256> table;
+    for (int i = 0; i < 256; ++i)
+    {
+      float c = i / 255.f;
+      table[i] = c <= 0.04045f ? c / 12.92f : std::pow((c + 0.055f) / 1.055f, 2.4f);
+    }
+    return table;
+  }();
+
+  const float r = linear[rgb[0]];
+  const float g = linear[rgb[1]];
+  const float b = linear[rgb[2]];
+
+  // sRGB to XYZ, normalised to the D65 white point
+  const float x = (0.4124564f * r + 0.3575761f * g + 0.1804375f * b) / 0.95047f;
+  const float y = (0.2126729f * r + 0.7151522f * g + 0.0721750f * b);
+  const float z = (0.0193339f * r + 0.1191920f * g + 0.9503041f * b) / 1.08883f;
+
+  auto f = [](float t) { return t > 0.008856f ? std::cbrt(t) : 7.787f * t + 16.f / 116.f; };
+  const float fx = f(x), fy = f(y), fz = f(z);
+
+  lab[0] = 116.f * fy - 16.f;
+  lab[1] = 500.f * (fx - fy);
+  lab[2] = 200.f * (fy - fz);
+}
+
+// Runs of identical pixels are skipped with a vectorised memcmp so only
+// differing pixels pay for the Lab conversion.
+double SumDeltaE(const unsigned char *a, const unsigned char *b, int pixel_count)
+{
+  double sum = 0.0;
+
+  for (int x = 0; x < pixel_count; x += 8)
+  {
+    const int run = std::min(8, pixel_count - x);
+    if (std::memcmp(a + x * 4, b + x * 4, run * 4) == 0) continue;
+
+    for (int p = x; p < x + run; ++p)
+    {
+      if (std::memcmp(a + p * 4, b + p * 4, 3) == 0) continue;
+
+      float lab_a[3], lab_b[3];
+      RgbToLab(a + p * 4, lab_a);
+      RgbToLab(b + p * 4, lab_b);
+
+      const float dl = lab_a[0] - lab_b[0];
+      const float da = lab_a[1] - lab_b[1];
+      const float db = lab_a[2] - lab_b[2];
+      sum += std::sqrt(dl * dl + da * da + db * db);
+    }
+  }
+
+  return sum;
+}
+
+// Mean CIE76 colour difference over the compared pixels.
+static double DeltaE(const DecodedImage& a, const DecodedImage& b, const std::vector<Tile>& tiles, const CompareMask *mask)
+{
+  const size_t stride = (size_t)a.Width() * 4;
+  std::vector<double> partial(tiles.size(), 0.0);
+
+  DefaultThreadPool().ParallelFor(tiles.size(), [&](size_t i) {
+    const auto& tile = tiles[i];
+
+    for (int y = tile.y; y < tile.y + tile.height; ++y)
+    {
+      const unsigned char *pa = a.Pixels() + y * stride;
+      const unsigned char *pb = b.Pixels() + y * stride;
+
+      auto accumulate = [&](int begin, int end) {
+        partial[i] += SumDeltaE(pa + (size_t)begin * 4, pb + (size_t)begin * 4, end - begin);
+      };
+
+      if (mask == nullptr) accumulate(tile.x, tile.x + tile.width);
+      else mask->ForEachSpan(y, tile.x, tile.x + tile.width, accumulate);
+    }
+  });
+
+  double total = 0.0;
+  for (double value : partial) total += value;
+
+  const size_t compared = mask ? mask->ComparedPixels() : a.PixelCount();
+  return compared == 0 ? 0.0 : total / (double)compared;
+}
+
+double MeasureDifference(Metric metric, const DecodedImage& a, const DecodedImage& b, const CompareMask *mask)
+{
+  return MeasureDifferenceInTiles(metric, a, b, SplitIntoTiles(a.Width(), a.Height()), mask);
+}
+
+double MeasureDifferenceInTiles(Metric metric, const DecodedImage& a, const DecodedImage& b, const std::vector<Tile>& tiles, const CompareMask *mask)
+{
+  switch (metric)
+  {
+    case Metric::Rmse: return AccumulateTiles(a, b, tiles, mask).Rmse();
+    case Metric::Psnr: return Psnr(AccumulateTiles(a, b, tiles, mask));
+    case Metric::Ssim: return Ssim(a, b, mask);
+    case Metric::DeltaE: return DeltaE(a, b, tiles, mask);
+  }
+
+  return 0.0;
+}
+
+double IdenticalValue(Metric metric)
+{
+  switch (metric)
+  {
+    case Metric::Rmse: return 0.0;
+    case Metric::Psnr: return std::numeric_limits<double>::infinity();
+    case Metric::Ssim: return 1.0;
+    case Metric::DeltaE: return 0.0;
+  }
+
+  return 0.0;
+}
+
+bool ExceedsThreshold(const CompareOptions& options, double value)
+{
+  switch (options.metric)
+  {
+    case Metric::Rmse:
+    case Metric::DeltaE:
+      return value > options.threshold;
+    case Metric::Psnr:
+    case Metric::Ssim:
+      return value < options.threshold;
+  }
+
+  return true;
+}
+
+double FailingSumOfSquares(const CompareOptions& options, size_t pixel_count)
+{
+  const double channels = (double)pixel_count * 3;
+
+  if (options.metric == Metric::Psnr)
+    return 255.0 * 255.0 / std::pow(10.0, options.threshold / 10.0) * channels;
+
+  return std::pow(options.threshold * 255.0, 2) * channels;
+}
+
+double ValueFromSumOfSquares(Metric metric, uint64_t sum_squares, size_t pixel_count)
+{
+  DifferenceAccumulator acc;
+  acc.sum_squares = sum_squares;
+  acc.pixel_count = pixel_count;
+
+  return metric == Metric::Psnr ? Psnr(acc) : acc.Rmse();
+}
+
+// Blocks of `level` that lie inside `tile`. Tiles are multiples of the
+// largest block, so every block belongs to exactly one tile.
+struct BlockRange
+{
+  int x_begin;
+  int x_end;
+  int y_begin;
+  int y_end;
+};
+
+static BlockRange BlocksInTile(const SumPyramid::Level& level, const Tile& tile)
+{
+  return {
+    tile.x / level.block_size,
+    std::min(level.width, (tile.x + tile.width) / level.block_size),
+    tile.y / level.block_size,
+    std::min(level.height, (tile.y + tile.height) / level.block_size)
+  };
+}
+
+SumPyramid BuildSumPyramid(const DecodedImage& image)
+{
+  return BuildSumPyramid(image, SplitIntoTiles(image.Width(), image.Height()));
+}
+
+SumPyramid BuildSumPyramid(const DecodedImage& image, const std::vector<Tile>& tiles)
+{
+  SumPyramid pyramid;
+
+  SumPyramid::Level level = { 4, image.Width() / 4, image.Height() / 4, {} };
+  if (level.width == 0 || level.height == 0) return pyramid;
+
+  level.sums.resize((size_t)level.width * level.height * 4);
+
+  const size_t stride = (size_t)image.Width() * 4;
+  DefaultThreadPool().ParallelFor(tiles.size(), [&](size_t i) {
+    const auto blocks = BlocksInTile(level, tiles[i]);
+    if (blocks.x_begin >= blocks.x_end) return;
+
+    for (int y = blocks.y_begin; y < blocks.y_end; ++y)
+    {
+      const size_t first = (size_t)y * level.width + blocks.x_begin;
+      SumRgbaBlocks(image.Pixels() + (size_t)y * 4 * stride + (size_t)blocks.x_begin * 16, stride, blocks.x_end - blocks.x_begin, &level.sums[first * 4]);
+    }
+  });
+
+  pyramid.levels.push_back(std::move(level));
+
+  while (pyramid.levels.size() < 3)
+  {
+    const auto& finer = pyramid.levels.back();
+    SumPyramid::Level coarser = { finer.block_size * 2, finer.width / 2, finer.height / 2, {} };
+    if (coarser.width == 0 || coarser.height == 0) break;
+
+    coarser.sums.resize((size_t)coarser.width * coarser.height * 4);
+
+    for (const auto& tile : tiles)
+    {
+      const auto blocks = BlocksInTile(coarser, tile);
+      if (blocks.x_begin >= blocks.x_end) continue;
+
+      for (int y = blocks.y_begin; y < blocks.y_end; ++y)
+      {
+        const uint16_t *row0 = &finer.sums[((size_t)y * 2 * finer.width + (size_t)blocks.x_begin * 2) * 4];
+        const size_t first = (size_t)y * coarser.width + blocks.x_begin;
+        SumBlockPairs(row0, row0 + finer.width * 4, blocks.x_end - blocks.x_begin, &coarser.sums[first * 4]);
+      }
+    }
+
+    pyramid.levels.push_back(std::move(coarser));
+  }
+
+  return pyramid;
+}
+
+bool FailsOnPyramid(const SumPyramid& golden, const SumPyramid& candidate, const std::vector<Tile>& tiles, const CompareOptions& options, size_t pixel_count)
+{
+  if (options.metric != Metric::Rmse && options.metric != Metric::Psnr) return false;
+  if (golden.levels.size() != candidate.levels.size()) return false;
+
+  const double limit = FailingSumOfSquares(options, pixel_count);
+
+  for (size_t i = golden.levels.size(); i-- > 0;)
+  {
+    const auto& a = golden.levels[i];
+    const auto& b = candidate.levels[i];
+    if (a.width != b.width || a.height != b.height) return false;
+
+    uint64_t sum_squares = 0;
+    for (const auto& tile : tiles)
+    {
+      const auto blocks = BlocksInTile(a, tile);
+
+      for (int y = blocks.y_begin; y < blocks.y_end; ++y)
+        for (size_t j = ((size_t)y * a.width + blocks.x_begin) * 4; j < ((size_t)y * a.width + blocks.x_end) * 4; ++j)
+        {
+          if (j % 4 == 3) continue;
+
+          const int64_t difference = (int)a.sums[j] - (int)b.sums[j];
+          sum_squares += difference * difference;
+        }
+    }
+
+    if ((double)(sum_squares / ((uint64_t)a.block_size * a.block_size)) > limit) return true;
+  }
+
+  return false;
+}
+
+bool AreImagesDifferent(const std::string& path1, const std::string& path2, double *distortion) {
+  return DefaultComparator().AreImagesDifferent(path1, path2, distortion);
 }
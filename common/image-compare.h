@@ -1,4 +1,226 @@
 #pragma once
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <list>
+#include <map>
+#include <memory>
+#include <mutex>
 #include <string>
+#include <vector>
+#include "compare-mask.h"
+#include "tile-manifest.h"
+
+extern "C"
+{
+  #include <raylib.h>
+}
+
+constexpr int TILE_SIZE = 64;
+
+struct Tile
+{
+  int x;
+  int y;
+  int width;
+  int height;
+};
+
+std::vector<Tile> SplitIntoTiles(int width, int height);
+
+enum class Metric
+{
+  Rmse,
+  Psnr,
+  Ssim,
+  DeltaE
+};
+
+enum class Backend
+{
+  Cpu,
+  Gpu
+};
+
+// How a comparison decides that two images differ. Rmse and DeltaE fail
+// when the value is above `threshold`, Psnr (in dB) and Ssim when it is
+// below it. The default is an exact RMSE match.
+//
+// With the Gpu backend, checks of the frame on screen run inside GL (see
+// gl-compare.h) and fall back to the CPU for what the GPU can't measure.
+struct CompareOptions
+{
+  Metric metric = Metric::Rmse;
+  double threshold = 0.0;
+  Backend backend = Backend::Cpu;
+};
+
+struct DifferenceStats
+{
+  double rmse;
+  int max_difference;
+  size_t differing_pixels;
+};
+
+// Owns a decoded RGBA8 raylib image and releases it when it goes out of scope.
+// Views wrap pixels owned by someone else, e.g. a mapped snapshot archive,
+// and must not outlive them. Screen captures live in DefaultCapturePool()
+// buffers that go back to the pool instead of being freed.
+class DecodedImage
+{
+  public:
+    DecodedImage();
+    explicit DecodedImage(Image image);
+    DecodedImage(DecodedImage&& other);
+    DecodedImage& operator=(DecodedImage&& other);
+    DecodedImage(const DecodedImage&) = delete;
+    DecodedImage& operator=(const DecodedImage&) = delete;
+    ~DecodedImage();
+
+    static DecodedImage Load(const std::string& path);
+    static DecodedImage FromScreen();
+    static DecodedImage View(const unsigned char *pixels, int width, int height);
+    static DecodedImage Pooled(unsigned char *pixels, int width, int height);
+
+    bool Export(const std::string& path) const;
+
+    bool Valid() const;
+    int Width() const;
+    int Height() const;
+    size_t PixelCount() const;
+    size_t SizeInBytes() const;
+    const unsigned char *Pixels() const;
+
+  private:
+    enum class Storage
+    {
+      Raylib,
+      View,
+      Pool
+    };
+
+    void Release();
+
+    Image image;
+    Storage storage;
+};
+
+// Per channel sums of 4x4, 8x8 and 16x16 pixel blocks. By Cauchy-Schwarz a
+// block's squared sum difference, divided by its pixel count, never exceeds
+// the squared differences of its pixels, so comparing coarse levels gives a
+// lower bound for RMSE and PSNR without touching full resolution pixels.
+struct SumPyramid
+{
+  struct Level
+  {
+    int block_size;
+    int width;
+    int height;
+    std::vector<uint16_t> sums;
+  };
+
+  std::vector<Level> levels;
+};
+
+SumPyramid BuildSumPyramid(const DecodedImage& image);
+// Only sums the blocks inside `tiles`, the others are left at zero.
+SumPyramid BuildSumPyramid(const DecodedImage& image, const std::vector<Tile>& tiles);
+
+// Tries to fail a thresholded RMSE or PSNR comparison of `pixel_count`
+// pixels from the coarsest level down, on the blocks inside `tiles` only.
+// Returns false when no level is conclusive. Tiles left out only weaken
+// the bound, so they can be masked or known to be identical.
+bool FailsOnPyramid(const SumPyramid& golden, const SumPyramid& candidate, const std::vector<Tile>& tiles, const CompareOptions& options, size_t pixel_count);
+
+// Keeps decoded golden images in memory between comparisons so long suites
+// only pay the PNG decode once per golden. The cache is bounded by
+// `capacity_bytes` and evicts the least recently used golden when full.
+//
+// Goldens recorded with a tile manifest next to them (see WriteTileManifest)
+// have candidates hashed tile by tile against it. The golden is only decoded,
+// and only the mismatching tiles measured, when some hash differs. Goldens
+// without an up to date manifest are decoded and measured whole.
+//
+// Volatile regions of a golden can be left out with SetMask(), or with a
+// `<golden>.mask.png` image next to it where black pixels are ignored.
+//
+// When only the verdict is wanted, i.e. `value` is null, thresholded RMSE
+// and PSNR comparisons first try to fail on a sum pyramid kept with each
+// golden, against one built from the candidate's mismatching tiles, and only
+// measure full resolution when it can't. A non-null `value` is always exact.
+//
+// Verdict-only RMSE, PSNR and DeltaE comparisons against a golden that isn't
+// cached decode it row by row against the candidate instead, and stop as
+// soon as the verdict is known.
+//
+// All members are safe to call from several threads. Goldens and manifests
+// are handed out as shared pointers so eviction never frees one in use.
+class Comparator
+{
+  public:
+    explicit Comparator(size_t capacity_bytes = 256 * 1024 * 1024);
+
+    bool AreImagesDifferent(const std::string& golden_path, const std::string& candidate_path, double *distortion);
+    bool IsDifferentFromGolden(const std::string& golden_path, const DecodedImage& candidate, const CompareOptions& options, double *value);
+
+    std::shared_ptr<const DecodedImage> Golden(const std::string& path);
+    std::shared_ptr<const SumPyramid> GoldenPyramid(const std::string& path);
+    std::shared_ptr<const TileManifest> Manifest(const std::string& golden_path);
+    std::shared_ptr<const CompareMask> Mask(const std::string& golden_path);
+    void SetMask(const std::string& golden_path, CompareMask mask);
+    // Drops a SetMask() mask, so the golden's sidecar mask, if any, applies again
+    void ResetMask(const std::string& golden_path);
+    void Forget(const std::string& path);
+    void Clear();
+
+  private:
+    struct CachedGolden
+    {
+      std::shared_ptr<const DecodedImage> image;
+      std::shared_ptr<const SumPyramid> pyramid;
+      std::filesystem::file_time_type modified;
+      std::list<std::string>::iterator recency;
+    };
+
+    struct CachedManifest
+    {
+      std::shared_ptr<const TileManifest> manifest;
+      std::filesystem::file_time_type modified;
+    };
+
+    void ForgetLocked(const std::string& path);
+    void EvictUntilFits(size_t bytes);
+
+    std::mutex mutex;
+    size_t capacity_bytes;
+    size_t cached_bytes;
+    std::map<std::string, CachedGolden> goldens;
+    std::list<std::string> recently_used;
+    std::map<std::string, CachedManifest> manifests;
+    std::map<std::string, std::shared_ptr<const CompareMask>> masks;
+};
+
+Comparator& DefaultComparator();
+
+DifferenceStats ComparePixels(const unsigned char *a, const unsigned char *b, size_t pixel_count);
+// Sum of the CIE76 colour differences of `pixel_count` RGBA8 pixels.
+double SumDeltaE(const unsigned char *a, const unsigned char *b, int pixel_count);
+
+// Computes `metric` over 64x64 tiles spread across DefaultThreadPool().
+// Both images, and `mask` if given, must have the same dimensions.
+double MeasureDifference(Metric metric, const DecodedImage& a, const DecodedImage& b, const CompareMask *mask = nullptr);
+
+// Same as MeasureDifference() when every tile outside `tiles` is known to be
+// identical. SSIM windows span tile borders, so it always measures the whole image.
+double MeasureDifferenceInTiles(Metric metric, const DecodedImage& a, const DecodedImage& b, const std::vector<Tile>& tiles, const CompareMask *mask = nullptr);
+
+// The value a metric reports for two identical images.
+double IdenticalValue(Metric metric);
+bool ExceedsThreshold(const CompareOptions& options, double value);
+// RMSE and PSNR fail once the sum of squared channel differences over
+// `pixel_count` pixels goes above this.
+double FailingSumOfSquares(const CompareOptions& options, size_t pixel_count);
+// RMSE or PSNR of `pixel_count` pixels whose channel differences squared add up to `sum_squares`.
+double ValueFromSumOfSquares(Metric metric, uint64_t sum_squares, size_t pixel_count);
 
 bool AreImagesDifferent(const std::string& path1, const std::string& path2, double *distortion);
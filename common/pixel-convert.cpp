@@ -0,0 +1,325 @@
+#include "pixel-convert.h"
+#include <cstdint>
+
+#if defined(__x86_64__)
+#include <immintrin.h>
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
+using ConvertKernel = void (*)(const unsigned char *, unsigned char *, size_t);
+
+static void RgbaFromRgbxScalar(const unsigned char *src, unsigned char *dst, size_t begin, size_t end)
+{
+  for (size_t i = begin; i < end; ++i)
+  {
+    dst[i * 4] = src[i * 4];
+    dst[i * 4 + 1] = src[i * 4 + 1];
+    dst[i * 4 + 2] = src[i * 4 + 2];
+    dst[i * 4 + 3] = 255;
+  }
+}
+
+static void RgbaFromRgbScalar(const unsigned char *src, unsigned char *dst, size_t begin, size_t end)
+{
+  for (size_t i = begin; i < end; ++i)
+  {
+    dst[i * 4] = src[i * 3];
+    dst[i * 4 + 1] = src[i * 3 + 1];
+    dst[i * 4 + 2] = src[i * 3 + 2];
+    dst[i * 4 + 3] = 255;
+  }
+}
+
+static void RgbFromRgbaScalar(const unsigned char *src, unsigned char *dst, size_t begin, size_t end)
+{
+  for (size_t i = begin; i < end; ++i)
+  {
+    dst[i * 3] = src[i * 4];
+    dst[i * 3 + 1] = src[i * 4 + 1];
+    dst[i * 3 + 2] = src[i * 4 + 2];
+  }
+}
+
+static void GrayFromRgbaScalar(const unsigned char *src, unsigned char *dst, size_t begin, size_t end)
+{
+  for (size_t i = begin; i < end; ++i)
+  {
+    const unsigned char *p = src + i * 4;
+    dst[i] = (unsigned char)((77 * p[0] + 150 * p[1] + 29 * p[2] + 128) >> 8);
+  }
+}
+
+static void SwapRedBlueScalar(const unsigned char *src, unsigned char *dst, size_t begin, size_t end)
+{
+  for (size_t i = begin; i < end; ++i)
+  {
+    const unsigned char r = src[i * 4];
+    dst[i * 4] = src[i * 4 + 2];
+    dst[i * 4 + 1] = src[i * 4 + 1];
+    dst[i * 4 + 2] = r;
+    dst[i * 4 + 3] = src[i * 4 + 3];
+  }
+}
+
+void RgbaFromRgbxPortable(const unsigned char *src, unsigned char *dst, size_t pixel_count)
+{
+  RgbaFromRgbxScalar(src, dst, 0, pixel_count);
+}
+
+void RgbaFromRgbPortable(const unsigned char *src, unsigned char *dst, size_t pixel_count)
+{
+  RgbaFromRgbScalar(src, dst, 0, pixel_count);
+}
+
+void RgbFromRgbaPortable(const unsigned char *src, unsigned char *dst, size_t pixel_count)
+{
+  RgbFromRgbaScalar(src, dst, 0, pixel_count);
+}
+
+void GrayFromRgbaPortable(const unsigned char *src, unsigned char *dst, size_t pixel_count)
+{
+  GrayFromRgbaScalar(src, dst, 0, pixel_count);
+}
+
+void SwapRedBluePortable(const unsigned char *src, unsigned char *dst, size_t pixel_count)
+{
+  SwapRedBlueScalar(src, dst, 0, pixel_count);
+}
+
+#if defined(__x86_64__)
+__attribute__((target("avx2")))
+static void RgbaFromRgbxAvx2(const unsigned char *src, unsigned char *dst, size_t pixel_count)
+{
+  const __m256i opaque = _mm256_set1_epi32((int)0xFF000000);
+  size_t i = 0;
+
+  for (; i + 8 <= pixel_count; i += 8)
+  {
+    __m256i v = _mm256_loadu_si256((const __m256i *)(src + i * 4));
+    _mm256_storeu_si256((__m256i *)(dst + i * 4), _mm256_or_si256(v, opaque));
+  }
+
+  RgbaFromRgbxScalar(src, dst, i, pixel_count);
+}
+
+// The RGB side of 8 pixels is 24 bytes, moved as two 16 byte halves 12
+// bytes apart. Those reach 4 bytes past the pixels, so the loop stops early
+// enough to stay inside the buffer.
+__attribute__((target("avx2")))
+static void RgbaFromRgbAvx2(const unsigned char *src, unsigned char *dst, size_t pixel_count)
+{
+  const __m256i spread = _mm256_setr_epi8(0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11, -1,
+                                          0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11, -1);
+  const __m256i opaque = _mm256_set1_epi32((int)0xFF000000);
+  size_t i = 0;
+
+  for (; i + 10 <= pixel_count; i += 8)
+  {
+    const unsigned char *rgb = src + i * 3;
+    __m256i v = _mm256_inserti128_si256(_mm256_castsi128_si256(_mm_loadu_si128((const __m128i *)rgb)),
+                                        _mm_loadu_si128((const __m128i *)(rgb + 12)), 1);
+    _mm256_storeu_si256((__m256i *)(dst + i * 4), _mm256_or_si256(_mm256_shuffle_epi8(v, spread), opaque));
+  }
+
+  RgbaFromRgbScalar(src, dst, i, pixel_count);
+}
+
+__attribute__((target("avx2")))
+static void RgbFromRgbaAvx2(const unsigned char *src, unsigned char *dst, size_t pixel_count)
+{
+  const __m256i pack = _mm256_setr_epi8(0, 1, 2, 4, 5, 6, 8, 9, 10, 12, 13, 14, -1, -1, -1, -1,
+                                        0, 1, 2, 4, 5, 6, 8, 9, 10, 12, 13, 14, -1, -1, -1, -1);
+  size_t i = 0;
+
+  for (; i + 10 <= pixel_count; i += 8)
+  {
+    __m256i v = _mm256_shuffle_epi8(_mm256_loadu_si256((const __m256i *)(src + i * 4)), pack);
+    unsigned char *rgb = dst + i * 3;
+
+    // The second half overwrites the 4 unused bytes the first one leaves
+    _mm_storeu_si128((__m128i *)rgb, _mm256_castsi256_si128(v));
+    _mm_storeu_si128((__m128i *)(rgb + 12), _mm256_extracti128_si256(v, 1));
+  }
+
+  RgbFromRgbaScalar(src, dst, i, pixel_count);
+}
+
+__attribute__((target("avx2")))
+static void GrayFromRgbaAvx2(const unsigned char *src, unsigned char *dst, size_t pixel_count)
+{
+  const __m256i weights = _mm256_set1_epi64x(0x0000001D0096004DLL);
+  const __m256i rounding = _mm256_set1_epi32(128);
+  const __m256i zero = _mm256_setzero_si256();
+  size_t i = 0;
+
+  for (; i + 8 <= pixel_count; i += 8)
+  {
+    __m256i v = _mm256_loadu_si256((const __m256i *)(src + i * 4));
+    __m256i lo = _mm256_madd_epi16(_mm256_unpacklo_epi8(v, zero), weights);
+    __m256i hi = _mm256_madd_epi16(_mm256_unpackhi_epi8(v, zero), weights);
+    __m256i y = _mm256_srli_epi32(_mm256_add_epi32(_mm256_hadd_epi32(lo, hi), rounding), 8);
+
+    // Each 128 bit lane now holds 4 pixels in order, narrowed to bytes
+    y = _mm256_packus_epi16(_mm256_packus_epi32(y, y), zero);
+    const uint32_t first = (uint32_t)_mm256_extract_epi32(y, 0);
+    const uint32_t second = (uint32_t)_mm256_extract_epi32(y, 4);
+    std::memcpy(dst + i, &first, 4);
+    std::memcpy(dst + i + 4, &second, 4);
+  }
+
+  GrayFromRgbaScalar(src, dst, i, pixel_count);
+}
+
+__attribute__((target("avx2")))
+static void SwapRedBlueAvx2(const unsigned char *src, unsigned char *dst, size_t pixel_count)
+{
+  const __m256i swap = _mm256_setr_epi8(2, 1, 0, 3, 6, 5, 4, 7, 10, 9, 8, 11, 14, 13, 12, 15,
+                                        2, 1, 0, 3, 6, 5, 4, 7, 10, 9, 8, 11, 14, 13, 12, 15);
+  size_t i = 0;
+
+  for (; i + 8 <= pixel_count; i += 8)
+  {
+    __m256i v = _mm256_loadu_si256((const __m256i *)(src + i * 4));
+    _mm256_storeu_si256((__m256i *)(dst + i * 4), _mm256_shuffle_epi8(v, swap));
+  }
+
+  SwapRedBlueScalar(src, dst, i, pixel_count);
+}
+#elif defined(__ARM_NEON)
+static void RgbaFromRgbxNeon(const unsigned char *src, unsigned char *dst, size_t pixel_count)
+{
+  const uint8x16_t opaque = vreinterpretq_u8_u32(vdupq_n_u32(0xFF000000));
+  size_t i = 0;
+
+  for (; i + 4 <= pixel_count; i += 4)
+    vst1q_u8(dst + i * 4, vorrq_u8(vld1q_u8(src + i * 4), opaque));
+
+  RgbaFromRgbxScalar(src, dst, i, pixel_count);
+}
+
+static void RgbaFromRgbNeon(const unsigned char *src, unsigned char *dst, size_t pixel_count)
+{
+  size_t i = 0;
+
+  for (; i + 16 <= pixel_count; i += 16)
+  {
+    const uint8x16x3_t rgb = vld3q_u8(src + i * 3);
+    const uint8x16x4_t rgba = { { rgb.val[0], rgb.val[1], rgb.val[2], vdupq_n_u8(255) } };
+    vst4q_u8(dst + i * 4, rgba);
+  }
+
+  RgbaFromRgbScalar(src, dst, i, pixel_count);
+}
+
+static void RgbFromRgbaNeon(const unsigned char *src, unsigned char *dst, size_t pixel_count)
+{
+  size_t i = 0;
+
+  for (; i + 16 <= pixel_count; i += 16)
+  {
+    const uint8x16x4_t rgba = vld4q_u8(src + i * 4);
+    const uint8x16x3_t rgb = { { rgba.val[0], rgba.val[1], rgba.val[2] } };
+    vst3q_u8(dst + i * 3, rgb);
+  }
+
+  RgbFromRgbaScalar(src, dst, i, pixel_count);
+}
+
+static uint8x8_t GrayNeon(uint8x8_t r, uint8x8_t g, uint8x8_t b)
+{
+  uint16x8_t sum = vmull_u8(r, vdup_n_u8(77));
+  sum = vmlal_u8(sum, g, vdup_n_u8(150));
+  sum = vmlal_u8(sum, b, vdup_n_u8(29));
+  return vrshrn_n_u16(sum, 8);
+}
+
+static void GrayFromRgbaNeon(const unsigned char *src, unsigned char *dst, size_t pixel_count)
+{
+  size_t i = 0;
+
+  for (; i + 16 <= pixel_count; i += 16)
+  {
+    const uint8x16x4_t p = vld4q_u8(src + i * 4);
+    const uint8x8_t lo = GrayNeon(vget_low_u8(p.val[0]), vget_low_u8(p.val[1]), vget_low_u8(p.val[2]));
+    const uint8x8_t hi = GrayNeon(vget_high_u8(p.val[0]), vget_high_u8(p.val[1]), vget_high_u8(p.val[2]));
+    vst1q_u8(dst + i, vcombine_u8(lo, hi));
+  }
+
+  GrayFromRgbaScalar(src, dst, i, pixel_count);
+}
+
+static void SwapRedBlueNeon(const unsigned char *src, unsigned char *dst, size_t pixel_count)
+{
+  size_t i = 0;
+
+  for (; i + 16 <= pixel_count; i += 16)
+  {
+    const uint8x16x4_t p = vld4q_u8(src + i * 4);
+    const uint8x16x4_t swapped = { { p.val[2], p.val[1], p.val[0], p.val[3] } };
+    vst4q_u8(dst + i * 4, swapped);
+  }
+
+  SwapRedBlueScalar(src, dst, i, pixel_count);
+}
+#endif
+
+void PixelConversion<PixelLayout::Rgbx, PixelLayout::Rgba>::Run(const unsigned char *src, unsigned char *dst, size_t pixel_count)
+{
+#if defined(__x86_64__)
+  static const ConvertKernel kernel = __builtin_cpu_supports("avx2") ? RgbaFromRgbxAvx2 : RgbaFromRgbxPortable;
+#elif defined(__ARM_NEON)
+  static const ConvertKernel kernel = RgbaFromRgbxNeon;
+#else
+  static const ConvertKernel kernel = RgbaFromRgbxPortable;
+#endif
+  kernel(src, dst, pixel_count);
+}
+
+void PixelConversion<PixelLayout::Rgb, PixelLayout::Rgba>::Run(const unsigned char *src, unsigned char *dst, size_t pixel_count)
+{
+#if defined(__x86_64__)
+  static const ConvertKernel kernel = __builtin_cpu_supports("avx2") ? RgbaFromRgbAvx2 : RgbaFromRgbPortable;
+#elif defined(__ARM_NEON)
+  static const ConvertKernel kernel = RgbaFromRgbNeon;
+#else
+  static const ConvertKernel kernel = RgbaFromRgbPortable;
+#endif
+  kernel(src, dst, pixel_count);
+}
+
+void PixelConversion<PixelLayout::Rgba, PixelLayout::Rgb>::Run(const unsigned char *src, unsigned char *dst, size_t pixel_count)
+{
+#if defined(__x86_64__)
+  static const ConvertKernel kernel = __builtin_cpu_supports("avx2") ? RgbFromRgbaAvx2 : RgbFromRgbaPortable;
+#elif defined(__ARM_NEON)
+  static const ConvertKernel kernel = RgbFromRgbaNeon;
+#else
+  static const ConvertKernel kernel = RgbFromRgbaPortable;
+#endif
+  kernel(src, dst, pixel_count);
+}
+
+void PixelConversion<PixelLayout::Rgba, PixelLayout::Gray>::Run(const unsigned char *src, unsigned char *dst, size_t pixel_count)
+{
+#if defined(__x86_64__)
+  static const ConvertKernel kernel = __builtin_cpu_supports("avx2") ? GrayFromRgbaAvx2 : GrayFromRgbaPortable;
+#elif defined(__ARM_NEON)
+  static const ConvertKernel kernel = GrayFromRgbaNeon;
+#else
+  static const ConvertKernel kernel = GrayFromRgbaPortable;
+#endif
+  kernel(src, dst, pixel_count);
+}
+
+void PixelConversion<PixelLayout::Rgba, PixelLayout::Bgra>::Run(const unsigned char *src, unsigned char *dst, size_t pixel_count)
+{
+#if defined(__x86_64__)
+  static const ConvertKernel kernel = __builtin_cpu_supports("avx2") ? SwapRedBlueAvx2 : SwapRedBluePortable;
+#elif defined(__ARM_NEON)
+  static const ConvertKernel kernel = SwapRedBlueNeon;
+#else
+  static const ConvertKernel kernel = SwapRedBluePortable;
+#endif
+  kernel(src, dst, pixel_count);
+}
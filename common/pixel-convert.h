@@ -0,0 +1,113 @@
+#pragma once
+#include <cstddef>
+#include <cstring>
+
+// 8 bit pixel layouts frames go through between readback, encoding and
+// comparison. Rgbx is RGBA whose alpha byte is undefined, as read back from
+// a framebuffer that may not have an alpha channel.
+enum class PixelLayout
+{
+  Rgba,
+  Rgbx,
+  Bgra,
+  Rgb,
+  Gray
+};
+
+constexpr size_t BytesPerPixel(PixelLayout layout)
+{
+  switch (layout)
+  {
+    case PixelLayout::Rgb: return 3;
+    case PixelLayout::Gray: return 1;
+    default: return 4;
+  }
+}
+
+// One kernel per pair of layouts, picked at compile time. Each has AVX2,
+// NEON and scalar versions, the best of which is chosen once at runtime.
+// Pairs without a specialisation below fail to compile.
+template <PixelLayout From, PixelLayout To>
+struct PixelConversion
+{
+  static_assert(From == To, "No kernel converts between these pixel layouts");
+
+  static void Run(const unsigned char *src, unsigned char *dst, size_t pixel_count)
+  {
+    std::memcpy(dst, src, pixel_count * BytesPerPixel(From));
+  }
+};
+
+// Forces alpha opaque
+template <>
+struct PixelConversion<PixelLayout::Rgbx, PixelLayout::Rgba>
+{
+  static void Run(const unsigned char *src, unsigned char *dst, size_t pixel_count);
+};
+
+template <>
+struct PixelConversion<PixelLayout::Rgb, PixelLayout::Rgba>
+{
+  static void Run(const unsigned char *src, unsigned char *dst, size_t pixel_count);
+};
+
+template <>
+struct PixelConversion<PixelLayout::Rgba, PixelLayout::Rgb>
+{
+  static void Run(const unsigned char *src, unsigned char *dst, size_t pixel_count);
+};
+
+// NTSC luma, the same weights as common/grayscale.fs in 8.8 fixed point.
+template <>
+struct PixelConversion<PixelLayout::Rgba, PixelLayout::Gray>
+{
+  static void Run(const unsigned char *src, unsigned char *dst, size_t pixel_count);
+};
+
+template <>
+struct PixelConversion<PixelLayout::Rgba, PixelLayout::Bgra>
+{
+  static void Run(const unsigned char *src, unsigned char *dst, size_t pixel_count);
+};
+
+template <>
+struct PixelConversion<PixelLayout::Bgra, PixelLayout::Rgba>
+{
+  static void Run(const unsigned char *src, unsigned char *dst, size_t pixel_count)
+  {
+    PixelConversion<PixelLayout::Rgba, PixelLayout::Bgra>::Run(src, dst, pixel_count);
+  }
+};
+
+// The scalar kernels behind the specialisations above, used when the CPU
+// has no SIMD path. The conversion tests hold the SIMD paths to them.
+void RgbaFromRgbxPortable(const unsigned char *src, unsigned char *dst, size_t pixel_count);
+void RgbaFromRgbPortable(const unsigned char *src, unsigned char *dst, size_t pixel_count);
+void RgbFromRgbaPortable(const unsigned char *src, unsigned char *dst, size_t pixel_count);
+void GrayFromRgbaPortable(const unsigned char *src, unsigned char *dst, size_t pixel_count);
+void SwapRedBluePortable(const unsigned char *src, unsigned char *dst, size_t pixel_count);
+
+template <PixelLayout From, PixelLayout To>
+void ConvertPixels(const unsigned char *src, unsigned char *dst, size_t pixel_count)
+{
+  PixelConversion<From, To>::Run(src, dst, pixel_count);
+}
+
+// Converts a tightly packed `width` x `height` image. With `flip` the rows
+// are also turned upside down, as GL reads them back bottom first. `src`
+// and `dst` must not overlap.
+template <PixelLayout From, PixelLayout To>
+void ConvertImage(const unsigned char *src, unsigned char *dst, int width, int height, bool flip)
+{
+  const size_t src_stride = (size_t)width * BytesPerPixel(From);
+  const size_t dst_stride = (size_t)width * BytesPerPixel(To);
+
+  if (!flip)
+  {
+    ConvertPixels<From, To>(src, dst, (size_t)width * height);
+    return;
+  }
+
+  for (int y = 0; y < height; ++y)
+    ConvertPixels<From, To>(src + (size_t)(height - 1 - y) * src_stride, dst + (size_t)y * dst_stride, width);
+}
@@ -0,0 +1,126 @@
+#include <cmath>
+#include <csetjmp>
+#include <vector>
+#include "png-stream.h"
+#include "compare-kernels.h"
+
+PngRowReader::PngRowReader(const std::string& path)
+  : file(nullptr), png(nullptr), info(nullptr), width(0), height(0), valid(false)
+{
+  file = fopen(path.c_str(), "rb");
+  if (file == nullptr) return;
+
+  png = png_create_read_struct(PNG_LIBPNG_VER_STRING, nullptr, nullptr, nullptr);
+  if (png == nullptr) return;
+
+  info = png_create_info_struct(png);
+  if (info == nullptr) return;
+
+  if (setjmp(png_jmpbuf(png))) return;
+
+  png_init_io(png, file);
+  png_read_info(png, info);
+
+  if (png_get_interlace_type(png, info) != PNG_INTERLACE_NONE) return;
+
+  // Whatever the stored format, rows come out as 8 bit RGBA
+  png_set_expand(png);
+  png_set_strip_16(png);
+  png_set_gray_to_rgb(png);
+  png_set_filler(png, 0xff, PNG_FILLER_AFTER);
+  png_read_update_info(png, info);
+
+  width = png_get_image_width(png, info);
+  height = png_get_image_height(png, info);
+  valid = png_get_rowbytes(png, info) == (size_t)width * 4;
+}
+
+PngRowReader::~PngRowReader()
+{
+  if (png != nullptr) png_destroy_read_struct(&png, info ? &info : nullptr, nullptr);
+  if (file != nullptr) fclose(file);
+}
+
+bool PngRowReader::Valid() const { return valid; }
+int PngRowReader::Width() const { return width; }
+int PngRowReader::Height() const { return height; }
+
+bool PngRowReader::ReadRow(unsigned char *rgba)
+{
+  if (!valid) return false;
+
+  if (setjmp(png_jmpbuf(png)))
+  {
+    valid = false;
+    return false;
+  }
+
+  png_read_row(png, rgba, nullptr);
+  return true;
+}
+
+bool CompareStreaming(const std::string& golden_path, const DecodedImage& candidate, const CompareOptions& options, const CompareMask *mask, bool *different, double *value)
+{
+  if (options.metric == Metric::Ssim) return false;
+
+  PngRowReader golden(golden_path);
+  if (!golden.Valid()) return false;
+
+  *different = true;
+  if (!candidate.Valid() || golden.Width() != candidate.Width() || golden.Height() != candidate.Height()) return true;
+
+  const int width = golden.Width();
+  if (mask != nullptr && (mask->Width() != width || mask->Height() != golden.Height())) mask = nullptr;
+  const size_t compared = mask ? mask->ComparedPixels() : (size_t)width * golden.Height();
+
+  // Every metric here only grows with each row, so crossing these limits
+  // decides the comparison. A zero limit fails on the first difference.
+  double limit = 0.0;
+  switch (options.metric)
+  {
+    case Metric::Rmse:
+    case Metric::Psnr: limit = FailingSumOfSquares(options, compared); break;
+    case Metric::DeltaE: limit = options.threshold * compared; break;
+    case Metric::Ssim: break;
+  }
+
+  std::vector<unsigned char> golden_row((size_t)width * 4);
+  const unsigned char *candidate_row = nullptr;
+  DifferenceAccumulator acc;
+  double delta_e = 0.0;
+
+  auto measure = [&](int begin, int end) {
+    const size_t offset = (size_t)begin * 4;
+
+    if (options.metric == Metric::DeltaE) delta_e += SumDeltaE(golden_row.data() + offset, candidate_row + offset, end - begin);
+    else AccumulateDifference(golden_row.data() + offset, candidate_row + offset, end - begin, &acc);
+  };
+
+  auto current_value = [&]() {
+    if (options.metric == Metric::DeltaE) return compared == 0 ? 0.0 : delta_e / compared;
+
+    return ValueFromSumOfSquares(options.metric, acc.sum_squares, compared);
+  };
+
+  for (int y = 0; y < golden.Height(); ++y)
+  {
+    if (!golden.ReadRow(golden_row.data())) return true;
+    candidate_row = candidate.Pixels() + (size_t)y * width * 4;
+
+    if (mask == nullptr) measure(0, width);
+    else mask->ForEachSpan(y, 0, width, measure);
+
+    const double accumulated = options.metric == Metric::DeltaE ? delta_e : (double)acc.sum_squares;
+
+    if (accumulated > limit)
+    {
+      *value = current_value();
+      return true;
+    }
+  }
+
+  *value = current_value();
+  *different = ExceedsThreshold(options, *value);
+
+  return true;
+}
@@ -0,0 +1,40 @@
+#pragma once
+#include <cstdio>
+#include <string>
+#include <png.h>
+#include "image-compare.h"
+
+// Decodes a PNG one RGBA8 scanline at a time, so only a row is ever held in
+// memory. Interlaced PNGs can't be streamed and are reported as invalid.
+class PngRowReader
+{
+  public:
+    explicit PngRowReader(const std::string& path);
+    PngRowReader(const PngRowReader&) = delete;
+    PngRowReader& operator=(const PngRowReader&) = delete;
+    ~PngRowReader();
+
+    bool Valid() const;
+    int Width() const;
+    int Height() const;
+
+    // Decodes the next row into `rgba`, which holds Width() pixels.
+    bool ReadRow(unsigned char *rgba);
+
+  private:
+    FILE *file;
+    png_structp png;
+    png_infop info;
+    int width;
+    int height;
+    bool valid;
+};
+
+// Compares a golden PNG, decoded row by row, with `candidate` and stops as
+// soon as the outcome is known: at the first differing row for exact
+// matches, or once the accumulated error provably crosses the threshold.
+// `*value` is then the bound reached so far rather than the final metric.
+//
+// Returns false without a verdict when the comparison can't be streamed,
+// i.e. for SSIM or interlaced goldens.
+bool CompareStreaming(const std::string& golden_path, const DecodedImage& candidate, const CompareOptions& options, const CompareMask *mask, bool *different, double *value);
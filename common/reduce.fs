@@ -0,0 +1,28 @@
+#version 330
+
+// Input uniform values
+uniform sampler2D texture0;     // Previous level of the reduction
+uniform ivec2 size;             // Size of the previous level
+
+// Output fragment color
+out vec4 finalColor;
+
+// Folds 4x4 texels of the previous level, summing each digit on its own
+void main()
+{
+    ivec2 origin = ivec2(gl_FragCoord.xy)*4;
+    vec3 result = vec3(0.0);
+
+    for (int y = 0; y < 4; y++)
+    {
+        for (int x = 0; x < 4; x++)
+        {
+            ivec2 p = origin + ivec2(x, y);
+            if (p.x >= size.x || p.y >= size.y) continue;
+
+            result += texelFetch(texture0, p, 0).rgb;
+        }
+    }
+
+    finalColor = vec4(result, 1.0);
+}
@@ -3,7 +3,10 @@ extern "C"
 #include <raylib.h>
 }
 #include <render.h>
+#include <map>
 #include <string>
+#include <vector>
+#include <sys/stat.h>
 
 void NullLog(int logLevel, const char *text, va_list args) {}
 
@@ -43,33 +46,83 @@ void DrawRenderTextureWithShader(RenderTexture target, Shader shader)
   EndDrawing();
 }
 
+struct LoadedShader
+{
+  Shader shader;
+  struct timespec modified;
+  off_t size;
+};
+
 static Model model;
 static RenderTexture2D target;
 static Texture2D texture;
-static Shader shader;
+static std::map<std::string, LoadedShader> shaders;
+static std::vector<void (*)()> releases;
 
-void RenderWithShader(const std::string& path, Point camera_position)
+// Shaders stay compiled between renders. A render only stats the file and
+// compiles it again when its modification time or size changed, so an
+// edited shader shows up on the next render.
+static Shader GetShader(const std::string& path)
+{
+  struct stat info = { 0 };
+  stat(path.c_str(), &info);
+
+  auto loaded = shaders.find(path);
+  if (loaded != shaders.end())
+  {
+    const LoadedShader& cached = loaded->second;
+    if (cached.modified.tv_sec == info.st_mtim.tv_sec && cached.modified.tv_nsec == info.st_mtim.tv_nsec && cached.size == info.st_size) return cached.shader;
+    UnloadShader(cached.shader);
+  }
+
+  // raylib falls back to its default shader when the file is missing
+  Shader shader = LoadShader(nullptr, path.c_str());
+  shaders[path] = { shader, info.st_mtim, info.st_size };
+
+  return shader;
+}
+
+void InitRenderContext()
 {
   SetTraceLogCallback(NullLog);
   SetConfigFlags(FLAG_OFFSCREEN_MODE);
   InitWindow(800, 600, "");
 
+  // Shader ids belong to the context they were compiled in
+  shaders.clear();
+
   model = LoadModel("assets/church.obj");
   texture = LoadTexture("assets/church_diffuse.png");
   model.materials[0].maps[MATERIAL_MAP_DIFFUSE].texture = texture;
 
-  shader = LoadShader(nullptr, path.c_str());
   target = LoadRenderTexture(800, 600);
+}
+
+void RenderWithShader(const std::string& path, Point camera_position)
+{
+  if (!IsWindowReady()) InitRenderContext();
+
+  Shader shader = GetShader(path);
 
   DrawModelToTexture(target, model, camera_position);
   DrawRenderTextureWithShader(target, shader);
 }
 
+void AtCleanUp(void (*release)())
+{
+  releases.push_back(release);
+}
+
 void CleanUp()
 {
+  for (auto release : releases) release();
+  releases.clear();
+
   UnloadTexture(texture);
   UnloadModel(model);
   UnloadRenderTexture(target);
-  UnloadShader(shader);
+  for (auto& loaded : shaders) UnloadShader(loaded.second.shader);
+  shaders.clear();
+
   CloseWindow();
 }
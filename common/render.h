@@ -7,6 +7,14 @@ struct Point {
   float z;
 };
 
+// Opens the offscreen window and loads the scene once, so tests only swap
+// shaders and cameras. RenderWithShader() calls it when nobody did.
+void InitRenderContext();
+
 void RenderWithShader(const std::string& path, Point camera_position = {3.f, 3.f, 3.f});
 
+// Registers `release` to free GL resources another module keeps between
+// renders. CleanUp() calls it once, before the context goes away.
+void AtCleanUp(void (*release)());
+
 void CleanUp();
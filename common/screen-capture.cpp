@@ -0,0 +1,32 @@
+#include <GL/gl.h>
+#include "image-compare.h"
+#include "capture-pool.h"
+#include "pixel-convert.h"
+
+// Reads the framebuffer straight into pooled buffers instead of going
+// through LoadImageFromScreen(), which allocates the frame twice. GL returns
+// rows bottom first and alpha may be undefined, so the readback is flipped
+// and made opaque in one pass, the way raylib captures have always been.
+DecodedImage DecodedImage::FromScreen()
+{
+  const int width = GetRenderWidth();
+  const int height = GetRenderHeight();
+  const size_t size = (size_t)width * height * 4;
+
+  auto& pool = DefaultCapturePool();
+  unsigned char *readback = pool.Acquire(size);
+  unsigned char *pixels = pool.Acquire(size);
+
+  if (readback == nullptr || pixels == nullptr)
+  {
+    pool.Release(readback);
+    pool.Release(pixels);
+    return DecodedImage();
+  }
+
+  glReadPixels(0, 0, width, height, GL_RGBA, GL_UNSIGNED_BYTE, readback);
+  ConvertImage<PixelLayout::Rgbx, PixelLayout::Rgba>(readback, pixels, width, height, true);
+  pool.Release(readback);
+
+  return Pooled(pixels, width, height);
+}
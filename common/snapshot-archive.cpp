@@ -0,0 +1,464 @@
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <sstream>
+#include <thread>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "snapshot-archive.h"
+#include "compare-kernels.h"
+
+constexpr char ARCHIVE_MAGIC[8] = { 'S', 'N', 'A', 'P', 'A', 'R', 'C', 'H' };
+constexpr uint32_t ARCHIVE_VERSION = 2;
+constexpr size_t ARCHIVE_ALIGNMENT = 64;
+
+SnapshotArchive::SnapshotArchive() : data(nullptr), size(0), entries(nullptr), entry_count(0) {}
+
+SnapshotArchive::SnapshotArchive(SnapshotArchive&& other)
+  : data(other.data), size(other.size), entries(other.entries), entry_count(other.entry_count)
+{
+  other.data = nullptr;
+  other.entries = nullptr;
+  other.size = other.entry_count = 0;
+}
+
+SnapshotArchive& SnapshotArchive::operator=(SnapshotArchive&& other)
+{
+  if (this != &other)
+  {
+    Close();
+    data = other.data;
+    size = other.size;
+    entries = other.entries;
+    entry_count = other.entry_count;
+    other.data = nullptr;
+    other.entries = nullptr;
+    other.size = other.entry_count = 0;
+  }
+
+  return *this;
+}
+
+SnapshotArchive::~SnapshotArchive()
+{
+  Close();
+}
+
+void SnapshotArchive::Close()
+{
+  if (data != nullptr) munmap((void *)data, size);
+
+  data = nullptr;
+  entries = nullptr;
+  size = entry_count = 0;
+}
+
+static bool IsValidIndex(size_t size, const ArchiveEntry *entries, size_t count)
+{
+  for (size_t i = 0; i < count; ++i)
+  {
+    const auto& entry = entries[i];
+
+    if (i > 0 && entries[i - 1].id >= entry.id) return false;
+    if (entry.width <= 0 || entry.height <= 0) return false;
+    if (entry.offset % ARCHIVE_ALIGNMENT != 0) return false;
+    if (entry.offset > size || entry.size > size - entry.offset) return false;
+
+    if (entry.format == PIXELFORMAT_UNCOMPRESSED_R8G8B8A8 &&
+        entry.size != (uint64_t)entry.width * entry.height * 4) {
+      return false;
+    }
+
+    if (entry.format == ARCHIVE_FORMAT_DELTA && entry.base != ARCHIVE_NO_BASE)
+    {
+      // Bases come earlier in the index, which also rules out cycles
+      auto base = std::lower_bound(entries, entries + i, entry.base, [](const ArchiveEntry& e, int id) { return e.id < id; });
+      if (base == entries + i || base->id != entry.base) return false;
+      if (base->width != entry.width || base->height != entry.height) return false;
+    }
+    else if (entry.format != PIXELFORMAT_UNCOMPRESSED_R8G8B8A8 && entry.format != ARCHIVE_FORMAT_DELTA)
+      return false;
+  }
+
+  return true;
+}
+
+SnapshotArchive SnapshotArchive::Open(const std::string& path)
+{
+  SnapshotArchive archive;
+
+  int fd = open(path.c_str(), O_RDONLY);
+  if (fd < 0) return archive;
+
+  struct stat info;
+  if (fstat(fd, &info) != 0 || (size_t)info.st_size < sizeof(ArchiveHeader))
+  {
+    close(fd);
+    return archive;
+  }
+
+  void *mapped = mmap(nullptr, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (mapped == MAP_FAILED) return archive;
+
+  archive.data = (const unsigned char *)mapped;
+  archive.size = info.st_size;
+
+  ArchiveHeader header;
+  std::memcpy(&header, archive.data, sizeof(header));
+
+  const size_t index_size = (size_t)header.entry_count * sizeof(ArchiveEntry);
+
+  if (std::memcmp(header.magic, ARCHIVE_MAGIC, sizeof(ARCHIVE_MAGIC)) != 0 ||
+      header.version != ARCHIVE_VERSION ||
+      index_size > archive.size - sizeof(ArchiveHeader)) {
+    archive.Close();
+    return archive;
+  }
+
+  archive.entries = (const ArchiveEntry *)(archive.data + sizeof(ArchiveHeader));
+  archive.entry_count = header.entry_count;
+
+  if (!IsValidIndex(archive.size, archive.entries, archive.entry_count))
+    archive.Close();
+
+  return archive;
+}
+
+bool SnapshotArchive::Valid() const { return data != nullptr; }
+size_t SnapshotArchive::Size() const { return entry_count; }
+const ArchiveEntry& SnapshotArchive::Entry(size_t index) const { return entries[index]; }
+
+const ArchiveEntry *SnapshotArchive::Find(int id) const
+{
+  const ArchiveEntry *end = entries + entry_count;
+  auto entry = std::lower_bound(entries, end, id, [](const ArchiveEntry& e, int id) { return e.id < id; });
+
+  return entry != end && entry->id == id ? entry : nullptr;
+}
+
+DecodedImage SnapshotArchive::Frame(const ArchiveEntry& entry) const
+{
+  if (entry.format != PIXELFORMAT_UNCOMPRESSED_R8G8B8A8) return DecodedImage();
+
+  return DecodedImage::View(data + entry.offset, entry.width, entry.height);
+}
+
+// Shifts every row left by `scroll_x` pixels (right when negative) and
+// fills the uncovered pixels with black.
+static void ScrollRows(unsigned char *pixels, int width, int height, int scroll_x)
+{
+  const int shift = std::min(std::abs(scroll_x), width);
+  const size_t kept = (size_t)(width - shift) * 4;
+
+  for (int y = 0; y < height; ++y)
+  {
+    unsigned char *row = pixels + (size_t)y * width * 4;
+
+    if (scroll_x > 0)
+    {
+      std::memmove(row, row + shift * 4, kept);
+      std::memset(row + kept, 0, (size_t)shift * 4);
+    }
+    else if (scroll_x < 0)
+    {
+      std::memmove(row + shift * 4, row, kept);
+      std::memset(row, 0, (size_t)shift * 4);
+    }
+  }
+}
+
+static DecodedImage OwnedCopy(const unsigned char *pixels, int width, int height)
+{
+  const size_t size = (size_t)width * height * 4;
+  Image image = { MemAlloc(size), width, height, 1, PIXELFORMAT_UNCOMPRESSED_R8G8B8A8 };
+  std::memcpy(image.data, pixels, size);
+
+  return DecodedImage(image);
+}
+
+// Turns `pixels`, holding the base frame of `entry`, into the entry's frame.
+bool SnapshotArchive::ApplyDelta(const ArchiveEntry& entry, unsigned char *pixels) const
+{
+  const size_t size = (size_t)entry.width * entry.height * 4;
+
+  if (entry.base == ARCHIVE_NO_BASE) std::memset(pixels, 0, size);
+  else ScrollRows(pixels, entry.width, entry.height, entry.scroll_x);
+
+  int residual_size = 0;
+  unsigned char *residual = DecompressData(data + entry.offset, entry.size, &residual_size);
+
+  if (residual == nullptr || (size_t)residual_size != size)
+  {
+    MemFree(residual);
+    return false;
+  }
+
+  for (size_t i = 0; i < size; ++i) pixels[i] ^= residual[i];
+
+  MemFree(residual);
+  return true;
+}
+
+DecodedImage SnapshotArchive::Decode(const ArchiveEntry& entry) const
+{
+  if (entry.format == PIXELFORMAT_UNCOMPRESSED_R8G8B8A8) return Frame(entry);
+
+  std::vector<const ArchiveEntry *> chain = { &entry };
+  while (chain.back()->format == ARCHIVE_FORMAT_DELTA && chain.back()->base != ARCHIVE_NO_BASE)
+    chain.push_back(Find(chain.back()->base));
+
+  std::vector<unsigned char> pixels((size_t)entry.width * entry.height * 4);
+
+  for (auto link = chain.rbegin(); link != chain.rend(); ++link)
+  {
+    if ((*link)->format == PIXELFORMAT_UNCOMPRESSED_R8G8B8A8)
+      std::memcpy(pixels.data(), data + (*link)->offset, pixels.size());
+    else if (!ApplyDelta(**link, pixels.data()))
+      return DecodedImage();
+  }
+
+  return OwnedCopy(pixels.data(), entry.width, entry.height);
+}
+
+GoldenSequence::GoldenSequence(const SnapshotArchive& archive) : archive(archive), current_entry(nullptr) {}
+
+DecodedImage GoldenSequence::Frame(int id)
+{
+  const ArchiveEntry *entry = archive.Find(id);
+  if (entry == nullptr) return DecodedImage();
+
+  const ArchiveEntry *previous = current_entry;
+  current_entry = entry;
+
+  if (entry->format == PIXELFORMAT_UNCOMPRESSED_R8G8B8A8)
+  {
+    current.clear();
+    return archive.Frame(*entry);
+  }
+
+  const size_t size = (size_t)entry->width * entry->height * 4;
+  const bool follows = previous != nullptr && previous->id == entry->base;
+
+  if (follows && current.empty())
+    current.assign(archive.data + previous->offset, archive.data + previous->offset + size);
+
+  if (!follows)
+  {
+    // Out of order, start over from the keyframe
+    auto decoded = archive.Decode(*entry);
+    if (!decoded.Valid())
+    {
+      current_entry = nullptr;
+      return DecodedImage();
+    }
+
+    current.assign(decoded.Pixels(), decoded.Pixels() + size);
+    return decoded;
+  }
+
+  current.resize(size);
+
+  if (!archive.ApplyDelta(*entry, current.data()))
+  {
+    current_entry = nullptr;
+    current.clear();
+    return DecodedImage();
+  }
+
+  return OwnedCopy(current.data(), entry->width, entry->height);
+}
+
+static size_t Align(size_t offset)
+{
+  return (offset + ARCHIVE_ALIGNMENT - 1) / ARCHIVE_ALIGNMENT * ARCHIVE_ALIGNMENT;
+}
+
+// Picks the horizontal scroll that best predicts `frame` from `previous`,
+// sampling every 8th row. Smaller scrolls win ties.
+static int EstimateScroll(const DecodedImage& previous, const DecodedImage& frame, int max_scroll)
+{
+  const int width = frame.Width();
+  const uint32_t *a = (const uint32_t *)previous.Pixels();
+  const uint32_t *b = (const uint32_t *)frame.Pixels();
+
+  int best_scroll = 0;
+  size_t best_cost = SIZE_MAX;
+
+  for (int step = 0; step <= 2 * max_scroll; ++step)
+  {
+    const int scroll = step % 2 == 0 ? step / 2 : -(step + 1) / 2;
+    size_t cost = 0;
+
+    for (int y = 0; y < frame.Height() && cost < best_cost; y += 8)
+    {
+      const uint32_t *row_a = a + (size_t)y * width;
+      const uint32_t *row_b = b + (size_t)y * width;
+
+      for (int x = 0; x < width; ++x)
+      {
+        const int source = x + scroll;
+        const uint32_t predicted = source >= 0 && source < width ? row_a[source] : 0;
+        cost += predicted != row_b[x];
+      }
+    }
+
+    if (cost < best_cost)
+    {
+      best_cost = cost;
+      best_scroll = scroll;
+    }
+  }
+
+  return best_scroll;
+}
+
+static std::vector<unsigned char> EncodeDelta(const DecodedImage *previous, const DecodedImage& frame, int scroll_x)
+{
+  std::vector<unsigned char> residual(frame.SizeInBytes(), 0);
+
+  if (previous != nullptr)
+  {
+    std::memcpy(residual.data(), previous->Pixels(), residual.size());
+    ScrollRows(residual.data(), frame.Width(), frame.Height(), scroll_x);
+  }
+
+  for (size_t i = 0; i < residual.size(); ++i) residual[i] ^= frame.Pixels()[i];
+
+  int compressed_size = 0;
+  unsigned char *compressed = CompressData(residual.data(), residual.size(), &compressed_size);
+  if (compressed == nullptr) return {};
+
+  std::vector<unsigned char> encoded(compressed, compressed + compressed_size);
+  MemFree(compressed);
+
+  return encoded;
+}
+
+bool WriteSnapshotArchive(const std::string& path, const std::map<int, DecodedImage>& frames, const ArchiveOptions& options)
+{
+  ArchiveHeader header;
+  std::memcpy(header.magic, ARCHIVE_MAGIC, sizeof(ARCHIVE_MAGIC));
+  header.version = ARCHIVE_VERSION;
+  header.entry_count = frames.size();
+
+  std::vector<ArchiveEntry> entries;
+  std::vector<std::vector<unsigned char>> deltas(frames.size());
+  size_t offset = Align(sizeof(ArchiveHeader) + frames.size() * sizeof(ArchiveEntry));
+
+  const DecodedImage *previous = nullptr;
+  int previous_id = ARCHIVE_NO_BASE;
+
+  for (const auto& [id, image] : frames)
+  {
+    if (!image.Valid()) return false;
+
+    const size_t index = entries.size();
+    const size_t stride = (size_t)image.Width() * 4;
+    ArchiveEntry entry = { id, image.Width(), image.Height(), PIXELFORMAT_UNCOMPRESSED_R8G8B8A8, ARCHIVE_NO_BASE, 0,
+                           offset, image.SizeInBytes(), HashPixels(image.Pixels(), stride, image.Width(), image.Height()) };
+
+    if (options.keyframe_interval > 0)
+    {
+      const bool keyframe = index % options.keyframe_interval == 0 || previous == nullptr ||
+                            previous->Width() != image.Width() || previous->Height() != image.Height();
+
+      entry.format = ARCHIVE_FORMAT_DELTA;
+      entry.base = keyframe ? ARCHIVE_NO_BASE : previous_id;
+      entry.scroll_x = keyframe ? 0 : EstimateScroll(*previous, image, options.max_scroll);
+
+      deltas[index] = EncodeDelta(keyframe ? nullptr : previous, image, entry.scroll_x);
+      if (deltas[index].empty()) return false;
+
+      entry.size = deltas[index].size();
+    }
+
+    entries.push_back(entry);
+    offset = Align(offset + entry.size);
+    previous = &image;
+    previous_id = id;
+  }
+
+  std::ostringstream temporary;
+  temporary << path << "." << std::this_thread::get_id() << ".tmp";
+
+  {
+    std::ofstream file(temporary.str(), std::ios::binary | std::ios::trunc);
+    if (!file) return false;
+
+    const char padding[ARCHIVE_ALIGNMENT] = { 0 };
+
+    file.write((const char *)&header, sizeof(header));
+    file.write((const char *)entries.data(), entries.size() * sizeof(ArchiveEntry));
+
+    size_t i = 0;
+    for (const auto& [id, image] : frames)
+    {
+      const auto& entry = entries[i];
+      const char *bytes = entry.format == ARCHIVE_FORMAT_DELTA ? (const char *)deltas[i].data() : (const char *)image.Pixels();
+
+      file.write(padding, entry.offset - file.tellp());
+      file.write(bytes, entry.size);
+      i++;
+    }
+
+    if (!file) return false;
+  }
+
+  std::error_code error;
+  std::filesystem::rename(temporary.str(), path, error);
+
+  return !error;
+}
+
+static bool MatchesHash(const ArchiveEntry& entry, const DecodedImage& candidate)
+{
+  const size_t stride = (size_t)candidate.Width() * 4;
+  return HashPixels(candidate.Pixels(), stride, candidate.Width(), candidate.Height()) == entry.hash;
+}
+
+bool IsDifferentFromArchived(const ArchiveEntry& entry, const DecodedImage& golden, const DecodedImage& candidate, const CompareOptions& options, double *value, const CompareMask *mask)
+{
+  if (!candidate.Valid() || entry.width != candidate.Width() || entry.height != candidate.Height())
+    return true;
+
+  if (MatchesHash(entry, candidate))
+  {
+    *value = IdenticalValue(options.metric);
+    return ExceedsThreshold(options, *value);
+  }
+
+  if (!golden.Valid()) return true;
+
+  *value = MeasureDifference(options.metric, golden, candidate, mask);
+  return ExceedsThreshold(options, *value);
+}
+
+bool IsDifferentFromArchived(const SnapshotArchive& archive, int id, const DecodedImage& candidate, const CompareOptions& options, double *value, const CompareMask *mask)
+{
+  const ArchiveEntry *entry = archive.Find(id);
+
+  if (entry == nullptr || !candidate.Valid() ||
+      entry->width != candidate.Width() ||
+      entry->height != candidate.Height()) {
+    return true;
+  }
+
+  // Only reconstruct the golden when the hash says it is needed
+  if (MatchesHash(*entry, candidate))
+  {
+    *value = IdenticalValue(options.metric);
+    return ExceedsThreshold(options, *value);
+  }
+
+  auto golden = archive.Decode(*entry);
+  if (!golden.Valid()) return true;
+
+  *value = MeasureDifference(options.metric, golden, candidate, mask);
+  return ExceedsThreshold(options, *value);
+}
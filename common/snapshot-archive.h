@@ -0,0 +1,114 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <string>
+#include <vector>
+#include "image-compare.h"
+
+// A single file holding many golden frames. The index maps a frame id to
+// where its pixels live in the file, so opening the archive is one mmap()
+// and reading a frame never copies or decodes anything.
+//
+//   header | entries sorted by id | frame data, each frame 64 byte aligned
+//
+// Frames are either raw RGBA8, mapped as they are, or deltas: the DEFLATE
+// compressed XOR of the frame with a prediction made by scrolling the
+// previous frame horizontally, which is how consecutive game frames differ.
+// A delta without a base frame is predicted from black, i.e. a compressed
+// keyframe. Deltas are best read in order through a GoldenSequence.
+constexpr int32_t ARCHIVE_FORMAT_DELTA = 0x100;
+constexpr int32_t ARCHIVE_NO_BASE = -1;
+
+struct ArchiveHeader
+{
+  char magic[8];
+  uint32_t version;
+  uint32_t entry_count;
+};
+
+struct ArchiveEntry
+{
+  int32_t id;
+  int32_t width;
+  int32_t height;
+  // raylib PixelFormat of the stored data, or ARCHIVE_FORMAT_DELTA
+  int32_t format;
+  // Delta frames only: the frame they are predicted from and the
+  // horizontal scroll applied to it, in pixels
+  int32_t base;
+  int32_t scroll_x;
+  uint64_t offset;
+  uint64_t size;
+  // HashPixels() of the frame
+  uint64_t hash;
+};
+
+class SnapshotArchive
+{
+  public:
+    SnapshotArchive();
+    SnapshotArchive(SnapshotArchive&& other);
+    SnapshotArchive& operator=(SnapshotArchive&& other);
+    SnapshotArchive(const SnapshotArchive&) = delete;
+    SnapshotArchive& operator=(const SnapshotArchive&) = delete;
+    ~SnapshotArchive();
+
+    // Returns an invalid archive when `path` is missing or malformed.
+    static SnapshotArchive Open(const std::string& path);
+
+    bool Valid() const;
+    size_t Size() const;
+    const ArchiveEntry& Entry(size_t index) const;
+    const ArchiveEntry *Find(int id) const;
+
+    // A view over the mapped pixels of a raw `entry`, valid while the archive
+    // is open. Delta entries return an invalid image, see Decode().
+    DecodedImage Frame(const ArchiveEntry& entry) const;
+    // Reconstructs any entry, following delta frames back to their keyframe.
+    DecodedImage Decode(const ArchiveEntry& entry) const;
+
+  private:
+    friend class GoldenSequence;
+
+    void Close();
+    bool ApplyDelta(const ArchiveEntry& entry, unsigned char *pixels) const;
+
+    const unsigned char *data;
+    size_t size;
+    const ArchiveEntry *entries;
+    size_t entry_count;
+};
+
+// Reconstructs frames while walking an archive in id order, so every delta
+// frame only costs inflating its residual on top of the previous one.
+class GoldenSequence
+{
+  public:
+    explicit GoldenSequence(const SnapshotArchive& archive);
+
+    // Frame `id`, or an invalid image when it is not archived. Raw frames are
+    // views into the archive, delta frames are owned copies.
+    DecodedImage Frame(int id);
+
+  private:
+    const SnapshotArchive& archive;
+    const ArchiveEntry *current_entry;
+    std::vector<unsigned char> current;
+};
+
+struct ArchiveOptions
+{
+  // Store frames as deltas, with a keyframe every `keyframe_interval` frames.
+  // Zero keeps every frame raw so it can be mapped directly.
+  int keyframe_interval = 0;
+  // Largest camera scroll searched for when predicting a delta frame.
+  int max_scroll = 256;
+};
+
+bool WriteSnapshotArchive(const std::string& path, const std::map<int, DecodedImage>& frames, const ArchiveOptions& options = {});
+
+// Compares `candidate` against the archived `golden` for `entry`, checking
+// the stored hash first so matching frames are never measured.
+bool IsDifferentFromArchived(const ArchiveEntry& entry, const DecodedImage& golden, const DecodedImage& candidate, const CompareOptions& options, double *value, const CompareMask *mask = nullptr);
+bool IsDifferentFromArchived(const SnapshotArchive& archive, int id, const DecodedImage& candidate, const CompareOptions& options, double *value, const CompareMask *mask = nullptr);
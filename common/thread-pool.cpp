@@ -0,0 +1,126 @@
+#include "thread-pool.h"
+#include <algorithm>
+#include <atomic>
+#include <exception>
+
+ThreadPool::ThreadPool(unsigned int num_threads) : stopping(false)
+{
+  num_threads = std::max(num_threads, 1u);
+
+  for (unsigned int i = 0; i < num_threads; ++i)
+    workers.emplace_back([this]() { WorkerLoop(); });
+}
+
+ThreadPool::~ThreadPool()
+{
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    stopping = true;
+  }
+
+  wake.notify_all();
+
+  for (auto& worker : workers)
+    worker.join();
+}
+
+unsigned int ThreadPool::Size() const
+{
+  return workers.size();
+}
+
+void ThreadPool::Enqueue(std::function<void()> task)
+{
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    tasks.push_back(std::move(task));
+  }
+
+  wake.notify_one();
+}
+
+void ThreadPool::WorkerLoop()
+{
+  while (true)
+  {
+    std::function<void()> task;
+
+    {
+      std::unique_lock<std::mutex> lock(mutex);
+      wake.wait(lock, [this]() { return stopping || !tasks.empty(); });
+
+      if (stopping && tasks.empty()) return;
+
+      task = std::move(tasks.front());
+      tasks.pop_front();
+    }
+
+    task();
+  }
+}
+
+void ThreadPool::ParallelFor(size_t count, const std::function<void(size_t)>& body)
+{
+  if (count == 0) return;
+
+  struct Progress
+  {
+    std::atomic<size_t> next{0};
+    std::atomic<size_t> finished{0};
+    std::atomic<bool> failed{false};
+    std::exception_ptr error;
+    std::mutex mutex;
+    std::condition_variable all_done;
+  };
+
+  // Helpers that only get scheduled after every index has been claimed find
+  // nothing left to do and never touch `body`, so it can live on our stack.
+  // Once `body` throws, the indices still to claim are skipped but counted,
+  // so the wait below ends and the first exception gets rethrown here.
+  auto progress = std::make_shared<Progress>();
+  auto work = [progress, &body, count]() {
+    size_t done = 0;
+
+    for (size_t i = progress->next++; i < count; i = progress->next++)
+    {
+      if (!progress->failed)
+      {
+        try
+        {
+          body(i);
+        }
+        catch (...)
+        {
+          std::lock_guard<std::mutex> lock(progress->mutex);
+          if (!progress->error) progress->error = std::current_exception();
+          progress->failed = true;
+        }
+      }
+
+      done++;
+    }
+
+    if (done > 0 && progress->finished.fetch_add(done) + done == count)
+    {
+      std::lock_guard<std::mutex> lock(progress->mutex);
+      progress->all_done.notify_all();
+    }
+  };
+
+  auto helpers = std::min<size_t>(count - 1, workers.size());
+  for (size_t i = 0; i < helpers; ++i)
+    Enqueue(work);
+
+  work();
+
+  std::unique_lock<std::mutex> lock(progress->mutex);
+  progress->all_done.wait(lock, [&]() { return progress->finished == count; });
+
+  if (progress->error) std::rethrow_exception(progress->error);
+}
+
+ThreadPool& DefaultThreadPool()
+{
+  static ThreadPool pool;
+  return pool;
+}
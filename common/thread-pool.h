@@ -0,0 +1,46 @@
+#pragma once
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+class ThreadPool
+{
+  public:
+    explicit ThreadPool(unsigned int num_threads = std::thread::hardware_concurrency());
+    ~ThreadPool();
+
+    template <class F>
+    auto Submit(F fn) -> std::future<decltype(fn())>
+    {
+      auto task = std::make_shared<std::packaged_task<decltype(fn())()>>(std::move(fn));
+      auto result = task->get_future();
+      Enqueue([task]() { (*task)(); });
+      return result;
+    }
+
+    // Runs body(0) ... body(count - 1) across the pool. The calling thread
+    // takes part in the work, so it is safe to call from inside a task.
+    // If body throws, the indices not started yet are skipped and the first
+    // exception is rethrown here once the others have finished.
+    void ParallelFor(size_t count, const std::function<void(size_t)>& body);
+
+    unsigned int Size() const;
+
+  private:
+    void Enqueue(std::function<void()> task);
+    void WorkerLoop();
+
+    std::vector<std::thread> workers;
+    std::deque<std::function<void()>> tasks;
+    std::mutex mutex;
+    std::condition_variable wake;
+    bool stopping;
+};
+
+ThreadPool& DefaultThreadPool();
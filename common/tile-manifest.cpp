@@ -0,0 +1,127 @@
+#include <algorithm>
+#include <filesystem>
+#include <fstream>
+#include <sstream>
+#include <thread>
+#include "tile-manifest.h"
+#include "image-compare.h"
+#include "compare-kernels.h"
+#include "thread-pool.h"
+
+constexpr int MANIFEST_VERSION = 2;
+// A PNG ends with its last IDAT chunk, whose CRC and zlib checksum cover the
+// compressed and decompressed pixels, followed by the 12 byte IEND chunk
+constexpr std::streamoff TAIL_BYTES = 64;
+
+static bool HashGoldenTail(const std::string& golden_path, uint64_t *size, uint64_t *hash)
+{
+  std::ifstream file(golden_path, std::ios::binary | std::ios::ate);
+  if (!file) return false;
+
+  const std::streamoff file_size = file.tellg();
+  const std::streamoff tail_size = std::min(file_size, TAIL_BYTES);
+  std::vector<unsigned char> tail(tail_size);
+
+  file.seekg(file_size - tail_size);
+  file.read((char *)tail.data(), tail_size);
+  if (!file) return false;
+
+  *size = file_size;
+  *hash = HashBytes(tail.data(), tail.size());
+
+  return true;
+}
+
+std::string TileManifestPath(const std::string& golden_path)
+{
+  return golden_path + ".tiles";
+}
+
+std::vector<uint64_t> HashTiles(const unsigned char *pixels, int width, int height)
+{
+  const auto tiles = SplitIntoTiles(width, height);
+  const size_t stride = (size_t)width * 4;
+  std::vector<uint64_t> hashes(tiles.size());
+
+  DefaultThreadPool().ParallelFor(tiles.size(), [&](size_t i) {
+    const auto& tile = tiles[i];
+    hashes[i] = HashPixels(pixels + tile.y * stride + (size_t)tile.x * 4, stride, tile.width, tile.height);
+  });
+
+  return hashes;
+}
+
+bool BuildTileManifest(const std::string& golden_path, const DecodedImage& golden, TileManifest *manifest)
+{
+  if (!golden.Valid()) return false;
+  if (!HashGoldenTail(golden_path, &manifest->golden_size, &manifest->golden_tail_hash)) return false;
+
+  manifest->width = golden.Width();
+  manifest->height = golden.Height();
+  manifest->tile_hashes = HashTiles(golden.Pixels(), golden.Width(), golden.Height());
+
+  return true;
+}
+
+bool LoadTileManifest(const std::string& golden_path, TileManifest *manifest)
+{
+  std::ifstream file(TileManifestPath(golden_path));
+  if (!file) return false;
+
+  std::string magic;
+  int version = 0, tile_size = 0;
+  size_t tile_count = 0;
+
+  file >> magic >> version;
+  if (magic != "tile-manifest" || version != MANIFEST_VERSION) return false;
+
+  file >> std::hex >> manifest->golden_size >> manifest->golden_tail_hash;
+  file >> std::dec >> manifest->width >> manifest->height >> tile_size >> tile_count;
+  if (!file || tile_size != TILE_SIZE) return false;
+
+  manifest->tile_hashes.resize(tile_count);
+  for (auto& hash : manifest->tile_hashes)
+    file >> std::hex >> hash;
+
+  if (!file || tile_count != SplitIntoTiles(manifest->width, manifest->height).size()) return false;
+
+  uint64_t golden_size = 0, golden_tail_hash = 0;
+  if (!HashGoldenTail(golden_path, &golden_size, &golden_tail_hash)) return false;
+
+  return golden_size == manifest->golden_size && golden_tail_hash == manifest->golden_tail_hash;
+}
+
+bool SaveTileManifest(const std::string& golden_path, const TileManifest& manifest)
+{
+  std::stringstream buffer;
+
+  buffer << "tile-manifest " << MANIFEST_VERSION << std::endl;
+  buffer << std::hex << manifest.golden_size << " " << manifest.golden_tail_hash << std::endl;
+  buffer << std::dec << manifest.width << " " << manifest.height << " " << TILE_SIZE << " " << manifest.tile_hashes.size() << std::endl;
+
+  for (auto hash : manifest.tile_hashes)
+    buffer << std::hex << hash << std::endl;
+
+  // Written aside and renamed so concurrent comparisons never read a partial file
+  std::stringstream temporary_path;
+  temporary_path << TileManifestPath(golden_path) << "." << std::this_thread::get_id() << ".tmp";
+
+  {
+    std::ofstream file(temporary_path.str());
+    if (!file) return false;
+
+    file << buffer.str();
+    if (!file) return false;
+  }
+
+  std::error_code error;
+  std::filesystem::rename(temporary_path.str(), TileManifestPath(golden_path), error);
+
+  return !error;
+}
+
+bool WriteTileManifest(const std::string& golden_path, const DecodedImage& golden)
+{
+  TileManifest manifest;
+  return BuildTileManifest(golden_path, golden, &manifest) && SaveTileManifest(golden_path, manifest);
+}
@@ -0,0 +1,31 @@
+#pragma once
+#include <cstdint>
+#include <string>
+#include <vector>
+
+class DecodedImage;
+
+// Sidecar file stored next to a golden image with one hash per tile (see
+// SplitIntoTiles), so a matching frame can be verified without decoding the
+// golden. Manifests are written when a golden is recorded and committed
+// with it. A stale one is detected by the golden's file size and a hash of
+// its last bytes, which hold the zlib and CRC checksums of all its pixel
+// data, so the check never reads the whole golden.
+struct TileManifest
+{
+  uint64_t golden_size = 0;
+  uint64_t golden_tail_hash = 0;
+  int width = 0;
+  int height = 0;
+  std::vector<uint64_t> tile_hashes;
+};
+
+std::string TileManifestPath(const std::string& golden_path);
+
+std::vector<uint64_t> HashTiles(const unsigned char *pixels, int width, int height);
+
+bool BuildTileManifest(const std::string& golden_path, const DecodedImage& golden, TileManifest *manifest);
+bool LoadTileManifest(const std::string& golden_path, TileManifest *manifest);
+bool SaveTileManifest(const std::string& golden_path, const TileManifest& manifest);
+// Builds and saves the manifest of a golden that was just written
+bool WriteTileManifest(const std::string& golden_path, const DecodedImage& golden);
@@ -1,5 +1,6 @@
 #include <raylib.h>
 #include <render.h>
+#include <image-compare.h>
 #include <cstring>
 
 int main(int argc, char *argv[])
@@ -11,7 +12,7 @@ int main(int argc, char *argv[])
   auto z = std::stof(argv[3]);
 
   RenderWithShader("common/bloom.fs", { x, y, z });
-  TakeScreenshot("build/api-out.png");
+  DecodedImage::FromScreen().Export("build/api-out.png");
 
   CleanUp();
   return 0;
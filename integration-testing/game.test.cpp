@@ -8,6 +8,8 @@ describe("JumpingGame", []() {
     auto headless_mode = true;
     Game game(headless_mode);
 
+    ignoreRegion({ 0, 0, 120, 40 });
+
     onEveryNthFrame(6, [](int _) { Platform::ForceJumpKey(); });
     onEveryNthFrame(FRAME_SKIP, [](int frame) { Screenshot(frame); });
     runFrames(NUM_FRAMES_TO_RENDER, [&]() { game.DoFrame(); });
@@ -1,19 +1,39 @@
 #pragma once
 #include <functional>
 #include <map>
+#include <memory>
+#include <optional>
+#include <vector>
 #include <string>
 #include <raylib.h>
 #include <filesystem>
 #include <image-compare.h>
+#include <failure-report.h>
+#include <snapshot-archive.h>
+#include <thread-pool.h>
+#include <tile-manifest.h>
 
 #define VerifyFramesSnapshot()  _VerifyFramesSnapshot(OnFailure(__FILE__, __LINE__ - 1))
+#define VerifyFramesSnapshotWith(...)  _VerifyFramesSnapshot(OnFailure(__FILE__, __LINE__ - 1), __VA_ARGS__)
 
 constexpr int NUM_FRAMES_TO_RENDER = 70;
 constexpr int FRAME_SKIP = 4;
 
-static inline std::function<void(std::string, double, int)> OnFailure(const char *file, int line) {
-  return [=](std::string url, double distortion, int frame) {
-    throw cest::AssertionError(file, line, "Rendered images do not match. " + std::to_string(distortion*100.0)  + "% distortion after frame " + std::to_string(frame) + ". Uploaded video to " + url);
+struct FrameFailure
+{
+  int frame;
+  double distortion;
+  std::string artifact;
+};
+
+static inline std::function<void(const std::vector<FrameFailure>&)> OnFailure(const char *file, int line) {
+  return [=](const std::vector<FrameFailure>& failures) {
+    std::string message = "Rendered images do not match in " + std::to_string(failures.size()) + " frames.";
+
+    for (const auto& failure : failures)
+      message += "\n     " + std::to_string(failure.distortion*100.0) + "% distortion after frame " + std::to_string(failure.frame) + ". Comparison saved to " + failure.artifact;
+
+    throw cest::AssertionError(file, line, message);
   };
 }
 
@@ -35,24 +55,95 @@ std::string FrameFilename(int frame)
   return "integration-testing/snapshots/" + std::to_string(frame) + ".png";
 }
 
-void _VerifyFramesSnapshot(std::function<void(std::string, double, int)> on_failure)
+std::string FailedFrameFilename(int frame)
+{
+  return "integration-testing/snapshots/failed_" + std::to_string(frame) + ".png";
+}
+
+// When present, goldens are read from this archive instead of one PNG per
+// frame. Build it with `snapshot-tool pack` from the PNGs in snapshots/.
+const std::string SNAPSHOT_ARCHIVE = "integration-testing/snapshots.snap";
+
+static const SnapshotArchive& GoldenArchive()
+{
+  static SnapshotArchive archive = SnapshotArchive::Open(SNAPSHOT_ARCHIVE);
+  return archive;
+}
+
+static std::map<int, DecodedImage> captured_frames;
+static std::vector<Rectangle> ignored_regions;
+
+// Leaves `region` out of the frame comparisons of the current test case,
+// e.g. the FPS counter.
+static inline void ignoreRegion(Rectangle region)
+{
+  ignored_regions.push_back(region);
+}
+
+static std::optional<FrameFailure> VerifyFrame(int frame, const DecodedImage& image, const CompareOptions& options, const SnapshotArchive& archive)
+{
+  double distortion = 0.0;
+
+  std::optional<CompareMask> mask;
+  if (!ignored_regions.empty())
+    mask = CompareMask::FromRectangles(image.Width(), image.Height(), ignored_regions);
+
+  const ArchiveEntry *entry = archive.Valid() ? archive.Find(frame) : nullptr;
+  bool different = false;
+
+  // Archived goldens are checked against their stored hash first and only
+  // rebuilt, from their keyframe, when the frame doesn't match it
+  if (entry != nullptr)
+    different = IsDifferentFromArchived(archive, frame, image, options, &distortion, mask ? &*mask : nullptr);
+  else
+  {
+    if (mask) DefaultComparator().SetMask(FrameFilename(frame), *mask);
+    else DefaultComparator().ResetMask(FrameFilename(frame));
+    different = DefaultComparator().IsDifferentFromGolden(FrameFilename(frame), image, options, &distortion);
+  }
+
+  if (!different)
+  {
+    RemoveFile(NewFrameFilename(frame));
+    RemoveFile(FailedFrameFilename(frame));
+    return std::nullopt;
+  }
+
+  image.Export(NewFrameFilename(frame));
+
+  if (entry != nullptr)
+    WriteFailureArtifact(archive.Decode(*entry), image, FailedFrameFilename(frame));
+  else if (auto golden = DefaultComparator().Golden(FrameFilename(frame)))
+    WriteFailureArtifact(*golden, image, FailedFrameFilename(frame));
+
+  return FrameFailure { frame, distortion, FailedFrameFilename(frame) };
+}
+
+void _VerifyFramesSnapshot(std::function<void(const std::vector<FrameFailure>&)> on_failure, const CompareOptions& options = { Metric::Rmse, 0.2 })
 {
-  for (int i=0; i<NUM_FRAMES_TO_RENDER; i+=FRAME_SKIP) {
-    if (!FileExists(NewFrameFilename(i))) continue;
+  std::vector<std::future<std::optional<FrameFailure>>> results;
+  const SnapshotArchive *archive = &GoldenArchive();
 
-    double distortion = 0.0;
-    auto difference = AreImagesDifferent(FrameFilename(i), NewFrameFilename(i), &distortion);
+  for (const auto& [frame, image] : captured_frames) {
+    const DecodedImage *captured = &image;
 
-    if (difference && distortion > 0.2)
-    {
-      on_failure("url", distortion, i);
-    }
+    results.push_back(DefaultThreadPool().Submit([frame = frame, captured, options, archive]() {
+      return VerifyFrame(frame, *captured, options, *archive);
+    }));
   }
 
-  for (int i=0; i<NUM_FRAMES_TO_RENDER; i+=FRAME_SKIP) {
-    if (!FileExists(NewFrameFilename(i))) continue;
-    RemoveFile(NewFrameFilename(i));
+  std::vector<FrameFailure> failures;
+
+  for (auto& result : results) {
+    auto failure = result.get();
+    if (failure) failures.push_back(*failure);
   }
+
+  // Regions ignored by this test case must not mask the next one's frames
+  captured_frames.clear();
+  ignored_regions.clear();
+
+  if (!failures.empty()) on_failure(failures);
 }
 
 struct FrameAction
@@ -82,7 +173,16 @@ static inline void onEveryNthFrame(int frame, std::function<void(int)> action)
 void Screenshot(int frame)
 {
   auto filename = FrameFilename(frame);
-  if (FileExists(filename)) filename = NewFrameFilename(frame);
+  const auto& archive = GoldenArchive();
+  const bool archived = archive.Valid() && archive.Find(frame) != nullptr;
+
+  if (!archived && !FileExists(filename))
+  {
+    auto image = DecodedImage::FromScreen();
+    image.Export(filename);
+    WriteTileManifest(filename, image);
+    return;
+  }
 
-  TakeScreenshot(filename.c_str());
+  captured_frames[frame] = DecodedImage::FromScreen();
 }
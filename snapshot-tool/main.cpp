@@ -0,0 +1,151 @@
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+#include <map>
+#include <string>
+#include <snapshot-archive.h>
+#include <tile-manifest.h>
+
+// Packs golden PNGs named after their frame id into a snapshot archive and
+// unpacks them back for review. Also writes the tile manifests of golden
+// PNGs, for goldens that were not recorded by a test.
+//
+//   snapshot-tool pack [--delta <keyframe interval>] <archive> <frame.png>...
+//   snapshot-tool unpack <archive> <directory>
+//   snapshot-tool list <archive>
+//   snapshot-tool manifest <golden.png>...
+
+static int Pack(const std::string& archive_path, const ArchiveOptions& options, int count, char *paths[])
+{
+  std::map<int, DecodedImage> frames;
+
+  for (int i = 0; i < count; ++i)
+  {
+    const std::filesystem::path path(paths[i]);
+    int id = 0;
+
+    try { id = std::stoi(path.stem().string()); }
+    catch (const std::exception&)
+    {
+      fprintf(stderr, "%s is not named after a frame id\n", paths[i]);
+      return 1;
+    }
+
+    auto image = DecodedImage::Load(path.string());
+    if (!image.Valid())
+    {
+      fprintf(stderr, "Could not load %s\n", paths[i]);
+      return 1;
+    }
+
+    frames[id] = std::move(image);
+  }
+
+  if (!WriteSnapshotArchive(archive_path, frames, options))
+  {
+    fprintf(stderr, "Could not write %s\n", archive_path.c_str());
+    return 1;
+  }
+
+  printf("Packed %zu frames into %s\n", frames.size(), archive_path.c_str());
+  return 0;
+}
+
+static int Unpack(const SnapshotArchive& archive, const std::string& directory)
+{
+  std::filesystem::create_directories(directory);
+
+  for (size_t i = 0; i < archive.Size(); ++i)
+  {
+    const auto& entry = archive.Entry(i);
+    const auto path = directory + "/" + std::to_string(entry.id) + ".png";
+
+    if (!archive.Decode(entry).Export(path))
+    {
+      fprintf(stderr, "Could not export frame %d to %s\n", entry.id, path.c_str());
+      return 1;
+    }
+  }
+
+  printf("Unpacked %zu frames into %s\n", archive.Size(), directory.c_str());
+  return 0;
+}
+
+static int List(const SnapshotArchive& archive)
+{
+  for (size_t i = 0; i < archive.Size(); ++i)
+  {
+    const auto& entry = archive.Entry(i);
+    printf("%d\t%dx%d\t", entry.id, entry.width, entry.height);
+
+    if (entry.format != ARCHIVE_FORMAT_DELTA) printf("format %d", entry.format);
+    else if (entry.base == ARCHIVE_NO_BASE) printf("keyframe");
+    else printf("delta of %d, scroll %d", entry.base, entry.scroll_x);
+
+    printf("\t%llu bytes\t%016llx\n", (unsigned long long)entry.size, (unsigned long long)entry.hash);
+  }
+
+  return 0;
+}
+
+static int WriteManifests(int count, char *paths[])
+{
+  for (int i = 0; i < count; ++i)
+  {
+    auto golden = DecodedImage::Load(paths[i]);
+
+    if (!golden.Valid() || !WriteTileManifest(paths[i], golden))
+    {
+      fprintf(stderr, "Could not write the tile manifest of %s\n", paths[i]);
+      return 1;
+    }
+  }
+
+  printf("Wrote %d tile manifests\n", count);
+  return 0;
+}
+
+int main(int argc, char *argv[])
+{
+  SetTraceLogLevel(LOG_WARNING);
+
+  if (argc < 3)
+  {
+    fprintf(stderr, "Usage: %s pack|unpack|list <archive> [...] or manifest <golden.png>...\n", argv[0]);
+    return 1;
+  }
+
+  const std::string command = argv[1];
+
+  if (command == "pack")
+  {
+    ArchiveOptions options;
+    int first = 2;
+
+    if (std::string(argv[first]) == "--delta" && argc > first + 2)
+    {
+      options.keyframe_interval = std::max(1, std::atoi(argv[first + 1]));
+      first += 2;
+    }
+
+    return Pack(argv[first], options, argc - first - 1, argv + first + 1);
+  }
+
+  if (command == "manifest") return WriteManifests(argc - 2, argv + 2);
+
+  const std::string archive_path = argv[2];
+
+  auto archive = SnapshotArchive::Open(archive_path);
+  if (!archive.Valid())
+  {
+    fprintf(stderr, "%s is not a snapshot archive\n", archive_path.c_str());
+    return 1;
+  }
+
+  if (command == "unpack" && argc == 4) return Unpack(archive, argv[3]);
+  if (command == "list") return List(archive);
+
+  fprintf(stderr, "Usage: %s pack|unpack|list <archive> [...] or manifest <golden.png>...\n", argv[0]);
+  return 1;
+}
@@ -3,17 +3,34 @@
 #include "verify.h"
 
 describe("Post-processing Camera Shaders", []() {
-  it("renders all pixels with bloom effect", []() {
+  dependsOn({ "assets/church.obj", "assets/church_diffuse.png" });
+
+  beforeAll([]() {
+    InitRenderContext();
+  });
+
+  it("renders all pixels with bloom effect", { "common/bloom.fs", "RendersAllPixelsWithBloomEffect.png" }, []() {
     RenderWithShader("common/bloom.fs");
     Verify();
   });
 
-  it("renders all pixels in B&W", []() {
+  it("renders all pixels in B&W", { "common/grayscale.fs", "common/diff.fs", "common/reduce.fs", "RendersAllPixelsInB&w.png" }, []() {
     RenderWithShader("common/grayscale.fs");
-    Verify();
+    VerifyWith({ Metric::Rmse, 0.0, Backend::Gpu });
+  });
+
+  expectPerformance(0.25);
+
+  bench("renders a frame with the bloom shader", []() {
+    RenderWithShader("common/bloom.fs");
+  });
+
+  bench("captures and compares a frame", []() {
+    DecodedImage frame = DecodedImage::FromScreen();
+    MeasureDifference(Metric::Rmse, frame, frame);
   });
 
-  afterEach([]() {
+  afterAll([]() {
     CleanUp();
   });
 });
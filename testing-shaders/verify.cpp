@@ -5,9 +5,11 @@ extern "C"
 #include <iostream>
 #include <sstream>
 #include <filesystem>
-#include <fstream>
 #include <functional>
 #include "image-compare.h"
+#include "failure-report.h"
+#include "gl-compare.h"
+#include "tile-manifest.h"
 
 std::string GenerateVerifierFileName(const std::string& input) {
   std::stringstream ss(input);
@@ -27,6 +29,10 @@ std::string GenerateVerifierFileName(const std::string& input) {
   return result;
 }
 
+std::string GoldenFileName(const std::string& test_case_name) {
+  return GenerateVerifierFileName(test_case_name) + ".png";
+}
+
 bool FileExists(const std::string& path_name) {
   return std::filesystem::exists(path_name) && std::filesystem::is_regular_file(path_name);
 }
@@ -35,37 +41,44 @@ void RemoveFile(const std::string& path_name) {
   std::filesystem::remove(path_name);
 }
 
-std::string ReadFile(const std::string& path_name) {
-  std::ifstream file(path_name);
-  std::stringstream buffer;
-
-  buffer << file.rdbuf();
-
-  return buffer.str();
-}
-
-void VerifyImages(const std::string& test_case_name, std::function<void(std::string)> on_failure)
+void VerifyImages(const std::string& test_case_name, std::function<void(std::string)> on_failure, const CompareOptions& options)
 {
   auto saved_file = GenerateVerifierFileName(test_case_name);
   auto new_file = saved_file + "_new";
-  auto saved_file_full = saved_file + ".png";
+  auto saved_file_full = GoldenFileName(test_case_name);
   auto new_file_full = new_file + ".png";
+  auto failed_file_full = saved_file + "_failed.png";
 
   if (!FileExists(saved_file_full))
   {
-    TakeScreenshot(saved_file_full.c_str());
+    auto frame = DecodedImage::FromScreen();
+    frame.Export(saved_file_full);
+    WriteTileManifest(saved_file_full, frame);
     return;
   }
 
-  TakeScreenshot(new_file_full.c_str());
-
   double distortion = 0.0;
-  if (AreImagesDifferent(saved_file_full, new_file_full, &distortion))
+  bool different = true;
+  bool decided = false;
+
+  if (options.backend == Backend::Gpu)
+    decided = CompareScreenOnGpu(saved_file_full, options, &different, &distortion);
+
+  // The frame is only read back when it has to be compared or saved
+  if (!decided || different)
   {
-    system("./testing-shaders/upload-imgur.sh");
-    auto url = ReadFile("url");
-    RemoveFile("url");
-    on_failure(url);
+    auto frame = DecodedImage::FromScreen();
+
+    // Only the verdict is reported, so the comparator may decide it on its pyramid
+    if (decided || DefaultComparator().IsDifferentFromGolden(saved_file_full, frame, options, nullptr))
+    {
+      frame.Export(new_file_full);
+
+      auto golden = DefaultComparator().Golden(saved_file_full);
+      if (golden != nullptr) WriteFailureArtifact(*golden, frame, failed_file_full);
+
+      on_failure("Rendered images do not match. Comparison saved to " + failed_file_full);
+    }
   }
 
   RemoveFile(new_file_full);
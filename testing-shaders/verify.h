@@ -1,10 +1,17 @@
 #pragma once
+#include <image-compare.h>
 #define Verify()  VerifyImages(__cest_globals.current_test_case->name, OnFailure(__FILE__, __LINE__ - 1))
+#define VerifyWith(...)  VerifyImages(__cest_globals.current_test_case->name, OnFailure(__FILE__, __LINE__ - 1), __VA_ARGS__)
 
 static inline std::function<void(std::string)> OnFailure(const char *file, int line) {
-  return [=](std::string url) {
-    throw cest::AssertionError(file, line, "Rendered images do not match. Uploaded image to " + url);
+  return [=](std::string message) {
+    throw cest::AssertionError(file, line, message);
   };
 }
 
-void VerifyImages(const std::string& test_case_name, std::function<void(std::string)> on_failure);
+// The golden Verify() compares the screen against in a test case so named.
+// A missing golden is recorded from the screen and the test case fails, so
+// new goldens get reviewed and committed rather than passing unseen.
+std::string GoldenFileName(const std::string& test_case_name);
+
+void VerifyImages(const std::string& test_case_name, std::function<void(std::string)> on_failure, const CompareOptions& options = {});
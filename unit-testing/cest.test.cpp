@@ -0,0 +1,227 @@
+#include <cest>
+#include <cmath>
+#include <cstdio>
+#include <fstream>
+#include <set>
+#include <string>
+#include <vector>
+
+// A suite built by hand rather than with describe(), so sharding and the
+// cache can be run on it without touching the suites of this binary
+static cest::TestSuite *SyntheticSuite(const std::vector<std::string>& names, const std::vector<std::string>& inputs = {})
+{
+  auto suite = new cest::TestSuite();
+  suite->name = "Synthetic";
+
+  for (const auto& name : names)
+  {
+    cest::TestCase *test_case = cest::TestCaseBuilder(__FILE__, __LINE__, name, []() {}).build();
+    test_case->inputs = inputs;
+    suite->test_cases.push_back(test_case);
+  }
+
+  return suite;
+}
+
+static void DeleteSuite(cest::TestSuite *suite)
+{
+  for (cest::TestCase *test_case : suite->test_cases) delete test_case;
+  delete suite;
+}
+
+static std::vector<std::string> TestCaseNames(cest::TestSuite *suite)
+{
+  std::vector<std::string> names;
+  for (cest::TestCase *test_case : suite->test_cases) names.push_back(test_case->name);
+  return names;
+}
+
+static std::string AssertionMessage(std::function<void()> assertion)
+{
+  try
+  {
+    assertion();
+  }
+  catch (const cest::AssertionError& error)
+  {
+    return error.message;
+  }
+
+  return "";
+}
+
+static void WriteFile(const std::string& path, const std::string& contents)
+{
+  std::ofstream file(path, std::ios::binary | std::ios::trunc);
+  file << contents;
+}
+
+static std::string group_set_up;
+
+describe("cest", []() {
+  describe("Sharding", []() {
+    it("keeps every test case in exactly one shard", []() {
+      const std::vector<std::string> names = { "a", "b", "c", "d", "e", "f", "g" };
+      std::multiset<std::string> kept;
+
+      for (int index = 1; index <= 3; ++index)
+      {
+        auto suite = SyntheticSuite(names);
+        cest::keepShard(suite, index, 3, "");
+
+        const auto shard = TestCaseNames(suite);
+        expect(shard.size() >= 2 && shard.size() <= 3).toBeTruthy();
+        kept.insert(shard.begin(), shard.end());
+
+        DeleteSuite(suite);
+      }
+
+      expect(std::vector<std::string>(kept.begin(), kept.end())).toBe(names);
+    });
+
+    it("balances shards on the durations of a previous run", []() {
+      const std::string durations_path = "/tmp/cest-test-durations.results";
+      auto timed = SyntheticSuite({ "slow", "one", "two", "three", "four" });
+
+      for (cest::TestCase *test_case : timed->test_cases)
+        test_case->duration_ms = test_case->name == "slow" ? 40.0 : 10.0;
+
+      cest::saveResultsFile(durations_path, timed);
+      DeleteSuite(timed);
+
+      auto first = SyntheticSuite({ "slow", "one", "two", "three", "four" });
+      auto second = SyntheticSuite({ "slow", "one", "two", "three", "four" });
+      cest::keepShard(first, 1, 2, durations_path);
+      cest::keepShard(second, 2, 2, durations_path);
+
+      expect(TestCaseNames(first)).toBe(std::vector<std::string>{ "slow" });
+      expect(TestCaseNames(second)).toHaveLength(4);
+
+      DeleteSuite(first);
+      DeleteSuite(second);
+      std::remove(durations_path.c_str());
+    });
+  });
+
+  // Every test case has files of its own, as workers run them side by side
+  describe("Test cache", []() {
+    it("skips passed test cases until one of their inputs changes", []() {
+      const std::string cache_path = "/tmp/cest-test-skips.cache";
+      const std::string input_path = "/tmp/cest-test-skips.txt";
+
+      std::remove(cache_path.c_str());
+      WriteFile(input_path, "first");
+
+      auto passed = SyntheticSuite({ "reads the input" }, { input_path });
+      cest::saveTestCache(passed, cache_path, "");
+      DeleteSuite(passed);
+
+      auto unchanged = SyntheticSuite({ "reads the input" }, { input_path });
+      cest::applyTestCache(unchanged, cache_path, "");
+      expect(unchanged->test_cases[0]->cached).toBeTruthy();
+      DeleteSuite(unchanged);
+
+      WriteFile(input_path, "second");
+
+      auto changed = SyntheticSuite({ "reads the input" }, { input_path });
+      cest::applyTestCache(changed, cache_path, "");
+      expect(changed->test_cases[0]->cached).toBeFalsy();
+      DeleteSuite(changed);
+
+      std::remove(cache_path.c_str());
+      std::remove(input_path.c_str());
+    });
+
+    it("forgets test cases that failed", []() {
+      const std::string cache_path = "/tmp/cest-test-forgets.cache";
+      const std::string input_path = "/tmp/cest-test-forgets.txt";
+
+      std::remove(cache_path.c_str());
+      WriteFile(input_path, "first");
+
+      auto suite = SyntheticSuite({ "reads the input" }, { input_path });
+      cest::saveTestCache(suite, cache_path, "");
+
+      suite->test_cases[0]->failed = true;
+      cest::saveTestCache(suite, cache_path, "");
+      DeleteSuite(suite);
+
+      auto rerun = SyntheticSuite({ "reads the input" }, { input_path });
+      cest::applyTestCache(rerun, cache_path, "");
+      expect(rerun->test_cases[0]->cached).toBeFalsy();
+      DeleteSuite(rerun);
+
+      std::remove(cache_path.c_str());
+      std::remove(input_path.c_str());
+    });
+
+    it("never caches test cases that declare no inputs", []() {
+      const std::string cache_path = "/tmp/cest-test-no-inputs.cache";
+
+      std::remove(cache_path.c_str());
+
+      auto suite = SyntheticSuite({ "reads nothing" });
+      cest::saveTestCache(suite, cache_path, "");
+      cest::applyTestCache(suite, cache_path, "");
+      expect(suite->test_cases[0]->cached).toBeFalsy();
+      DeleteSuite(suite);
+
+      std::remove(cache_path.c_str());
+    });
+  });
+
+  describe("Matrix", []() {
+    matrix(
+      cest::withParameter<std::string>()
+        .withValue("common/bloom.fs", "bloom")
+        .withValue("common/grayscale.fs", "B&W"),
+      cest::withParameter<int>()
+        .withValue(1, "the front")
+        .withValue(2))
+    .beforeGroup([](const std::string& shader) {
+      group_set_up = shader;
+    })
+    .thenTest("renders {0} seen from {1}", [](const std::string& shader, int camera) {
+      const std::string shader_name = shader == "common/bloom.fs" ? "bloom" : "B&W";
+      const std::string camera_name = camera == 1 ? "the front" : "2";
+
+      expect(__cest_globals.current_test_case->name).toBe("renders " + shader_name + " seen from " + camera_name);
+      expect(group_set_up).toBe(shader);
+    });
+
+    matrix(
+      cest::withParameter<std::string>().withValue("common/bloom.fs", "bloom"),
+      cest::withParameter<int>().withValue(1, "the front"),
+      cest::withParameter<float>().withValue(0.5f, "half"))
+    .thenTest("renders {0}", [](const std::string&, int, float) {
+      expect(__cest_globals.current_test_case->name).toBe("renders bloom (the front, half)");
+    });
+  });
+
+  describe("Vector assertions", []() {
+    it("compare byte vectors whole", []() {
+      std::vector<uint8_t> expected(100000, 7);
+      std::vector<uint8_t> actual = expected;
+
+      expect(actual).toBe(expected);
+
+      actual[10] = 9;
+      actual[99999] = 0;
+
+      expect(AssertionMessage([&]() { expect(actual).toBe(expected); }))
+        .toBe("2 of 100000 vector items differ, the first at position 10, expected 7 but was 9, max difference 7");
+      expect(AssertionMessage([&]() { expect(expected).Not->toBe(expected); }))
+        .toBe("Expected vectors of 100000 items to differ");
+    });
+
+    it("report vectors of different sizes", []() {
+      expect(AssertionMessage([]() { expect(std::vector<int>{ 1, 2 }).toBe({ 1, 2, 3 }); }))
+        .toBe("Vector sizes do not match, expected 3 items but had 2 items");
+    });
+
+    it("compare floats item by item", []() {
+      expect(std::vector<float>{ -0.f, 1.f }).toBe({ 0.f, 1.f });
+      expect(AssertionMessage([]() { expect(std::vector<float>{ NAN }).toBe({ NAN }); })).Not->toBe("");
+    });
+  });
+});
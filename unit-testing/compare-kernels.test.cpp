@@ -0,0 +1,168 @@
+#include <cest>
+#include <algorithm>
+#include <random>
+#include <vector>
+#include <compare-kernels.h>
+
+// Lengths around the vector widths of every SIMD path, and one long enough
+// to flush the 32 bit sums of AccumulateDifference() a few times
+static const std::vector<size_t> PIXEL_COUNTS = { 0, 1, 3, 4, 5, 7, 8, 9, 15, 17, 31, 33, 1000, 100003 };
+static const std::vector<size_t> BLOCK_COUNTS = { 1, 2, 3, 4, 5, 7, 9, 16, 33 };
+
+static std::vector<unsigned char> RandomBytes(size_t size, unsigned int seed)
+{
+  std::mt19937 random(seed);
+  std::uniform_int_distribution<int> byte(0, 255);
+  std::vector<unsigned char> bytes(size);
+
+  for (auto& b : bytes) b = (unsigned char)byte(random);
+
+  return bytes;
+}
+
+// Keeps most pixels equal, so differing pixel counts get exercised too
+static std::vector<unsigned char> Perturbed(std::vector<unsigned char> bytes, unsigned int seed)
+{
+  std::mt19937 random(seed);
+
+  for (size_t i = 0; i < bytes.size(); ++i)
+    if (random() % 5 == 0) bytes[i] = (unsigned char)random();
+
+  return bytes;
+}
+
+describe("Comparison kernels", []() {
+  it("accumulate the same differences as the portable kernel", []() {
+    for (size_t pixel_count : PIXEL_COUNTS)
+    {
+      // An odd offset so vector loads are never aligned
+      auto a = RandomBytes(pixel_count * 4 + 4, pixel_count);
+      auto b = Perturbed(a, pixel_count + 1);
+
+      DifferenceAccumulator dispatched;
+      DifferenceAccumulator portable;
+      AccumulateDifference(a.data() + 4, b.data() + 4, pixel_count, &dispatched);
+      AccumulateDifferencePortable(a.data() + 4, b.data() + 4, pixel_count, &portable);
+
+      expect(dispatched.sum_squares).toBe(portable.sum_squares);
+      expect(dispatched.differing_pixels).toBe(portable.differing_pixels);
+      expect(dispatched.max_difference).toBe(portable.max_difference);
+      expect(dispatched.pixel_count).toBe((uint64_t)pixel_count);
+    }
+  });
+
+  it("accumulate the same block moments as the portable kernel", []() {
+    for (size_t blocks : BLOCK_COUNTS)
+    {
+      const size_t stride = blocks * 4 + 3;
+      auto a = RandomBytes(stride * 4, blocks);
+      auto b = Perturbed(a, blocks + 1);
+
+      std::vector<BlockMoments> dispatched(blocks);
+      std::vector<BlockMoments> portable(blocks);
+      AccumulateBlockMoments(a.data(), b.data(), stride, blocks, dispatched.data());
+      AccumulateBlockMomentsPortable(a.data(), b.data(), stride, blocks, portable.data());
+
+      for (size_t i = 0; i < blocks; ++i)
+      {
+        expect(dispatched[i].sum_a).toBe(portable[i].sum_a);
+        expect(dispatched[i].sum_b).toBe(portable[i].sum_b);
+        expect(dispatched[i].sum_squares).toBe(portable[i].sum_squares);
+        expect(dispatched[i].sum_products).toBe(portable[i].sum_products);
+      }
+    }
+  });
+
+  it("sum the same RGBA blocks as the portable kernel", []() {
+    for (size_t blocks : BLOCK_COUNTS)
+    {
+      const size_t stride = blocks * 16 + 8;
+      auto rgba = RandomBytes(stride * 4, blocks);
+
+      std::vector<uint16_t> dispatched(blocks * 4);
+      std::vector<uint16_t> portable(blocks * 4);
+      SumRgbaBlocks(rgba.data(), stride, blocks, dispatched.data());
+      SumRgbaBlocksPortable(rgba.data(), stride, blocks, portable.data());
+
+      expect(dispatched).toBe(portable);
+    }
+  });
+
+  it("sum the same block pairs as the portable kernel", []() {
+    for (size_t blocks : BLOCK_COUNTS)
+    {
+      std::mt19937 random(blocks);
+      std::vector<uint16_t> row0(blocks * 8);
+      std::vector<uint16_t> row1(blocks * 8);
+
+      // Up to the sums of 8x8 blocks, the largest level they are summed from
+      for (size_t i = 0; i < row0.size(); ++i)
+      {
+        row0[i] = random() % (64 * 255 + 1);
+        row1[i] = random() % (64 * 255 + 1);
+      }
+
+      std::vector<uint16_t> dispatched(blocks * 4);
+      std::vector<uint16_t> portable(blocks * 4);
+      SumBlockPairs(row0.data(), row1.data(), blocks, dispatched.data());
+      SumBlockPairsPortable(row0.data(), row1.data(), blocks, portable.data());
+
+      expect(dispatched).toBe(portable);
+    }
+  });
+
+  it("keep the sums of white 16x16 blocks within 16 bits", []() {
+    const size_t width = 16 * 3;
+    std::vector<unsigned char> white(width * 16 * 4, 255);
+
+    std::vector<uint16_t> level4(4 * 12 * 4);
+    for (int y = 0; y < 4; ++y)
+      SumRgbaBlocks(white.data() + y * 4 * width * 4, width * 4, 12, level4.data() + y * 12 * 4);
+
+    std::vector<uint16_t> level8(2 * 6 * 4);
+    for (int y = 0; y < 2; ++y)
+      SumBlockPairs(level4.data() + y * 2 * 12 * 4, level4.data() + (y * 2 + 1) * 12 * 4, 6, level8.data() + y * 6 * 4);
+
+    std::vector<uint16_t> dispatched(3 * 4);
+    std::vector<uint16_t> portable(3 * 4);
+    SumBlockPairs(level8.data(), level8.data() + 6 * 4, 3, dispatched.data());
+    SumBlockPairsPortable(level8.data(), level8.data() + 6 * 4, 3, portable.data());
+
+    expect(dispatched).toBe(std::vector<uint16_t>(3 * 4, 16 * 16 * 255));
+    expect(portable).toBe(dispatched);
+  });
+
+  it("hash pixels to the same value as the portable kernel", []() {
+    for (int width : { 1, 7, 8, 9, 63, 64, 65 })
+    {
+      for (int height : { 1, 3, 64 })
+      {
+        const size_t stride = (size_t)width * 4 + 12;
+        auto pixels = RandomBytes(stride * height, width * 100 + height);
+
+        expect(HashPixels(pixels.data(), stride, width, height)).toBe(HashPixelsPortable(pixels.data(), stride, width, height));
+      }
+    }
+  });
+
+  it("hash pixels regardless of the row stride", []() {
+    const int width = 37;
+    const int height = 11;
+    auto padded = RandomBytes((width * 4 + 20) * height, 7);
+    std::vector<unsigned char> packed;
+
+    for (int y = 0; y < height; ++y)
+      packed.insert(packed.end(), padded.begin() + y * (width * 4 + 20), padded.begin() + y * (width * 4 + 20) + width * 4);
+
+    expect(HashPixels(padded.data(), width * 4 + 20, width, height)).toBe(HashPixels(packed.data(), width * 4, width, height));
+  });
+
+  it("hash moved content to a different value", []() {
+    auto pixels = RandomBytes(64 * 64 * 4, 11);
+    const uint64_t before = HashPixels(pixels.data(), 64 * 4, 64, 64);
+
+    std::rotate(pixels.begin(), pixels.begin() + 32 * 4, pixels.end());
+
+    expect(HashPixels(pixels.data(), 64 * 4, 64, 64)).Not->toBe(before);
+  });
+});
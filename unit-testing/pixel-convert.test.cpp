@@ -0,0 +1,116 @@
+#include <cest>
+#include <random>
+#include <vector>
+#include <sys/mman.h>
+#include <unistd.h>
+#include <pixel-convert.h>
+
+// Around the 8 pixels of the AVX2 loops, whose RGB side moves 10 pixels'
+// worth of bytes, and the 16 pixels of the NEON ones
+static const std::vector<size_t> PIXEL_COUNTS = { 0, 1, 3, 7, 8, 9, 10, 11, 15, 16, 17, 18, 19, 31, 33, 1000, 1001 };
+
+// Bytes that end right where an unreadable page starts, so a kernel that
+// reads or writes past them crashes its test case
+class GuardedBytes
+{
+  public:
+    explicit GuardedBytes(size_t size) : size(size)
+    {
+      const size_t page = sysconf(_SC_PAGESIZE);
+      mapped_size = (size + page - 1) / page * page + page;
+      mapped = (unsigned char *)mmap(nullptr, mapped_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+      mprotect(mapped + mapped_size - page, page, PROT_NONE);
+      bytes = mapped + mapped_size - page - size;
+    }
+
+    ~GuardedBytes()
+    {
+      munmap(mapped, mapped_size);
+    }
+
+    GuardedBytes(const GuardedBytes&) = delete;
+    GuardedBytes& operator=(const GuardedBytes&) = delete;
+
+    unsigned char *Data() { return bytes; }
+    std::vector<unsigned char> Copy() const { return std::vector<unsigned char>(bytes, bytes + size); }
+
+  private:
+    unsigned char *mapped;
+    size_t mapped_size;
+    unsigned char *bytes;
+    size_t size;
+};
+
+static void FillRandom(GuardedBytes& bytes, size_t size, unsigned int seed)
+{
+  std::mt19937 random(seed);
+  for (size_t i = 0; i < size; ++i) bytes.Data()[i] = (unsigned char)random();
+}
+
+// Runs `dispatched` and `portable` on the same random pixels, each into a
+// guarded buffer of exactly the converted size
+template <PixelLayout From, PixelLayout To>
+static void ExpectSameAsPortable(void (*portable)(const unsigned char *, unsigned char *, size_t))
+{
+  for (size_t pixel_count : PIXEL_COUNTS)
+  {
+    GuardedBytes src(pixel_count * BytesPerPixel(From));
+    GuardedBytes dispatched(pixel_count * BytesPerPixel(To));
+    GuardedBytes expected(pixel_count * BytesPerPixel(To));
+    FillRandom(src, pixel_count * BytesPerPixel(From), pixel_count);
+
+    ConvertPixels<From, To>(src.Data(), dispatched.Data(), pixel_count);
+    portable(src.Data(), expected.Data(), pixel_count);
+
+    expect(dispatched.Copy()).toBe(expected.Copy());
+  }
+}
+
+describe("Pixel conversions", []() {
+  it("force alpha opaque like the portable kernel", []() {
+    ExpectSameAsPortable<PixelLayout::Rgbx, PixelLayout::Rgba>(RgbaFromRgbxPortable);
+  });
+
+  it("expand RGB to RGBA like the portable kernel", []() {
+    ExpectSameAsPortable<PixelLayout::Rgb, PixelLayout::Rgba>(RgbaFromRgbPortable);
+  });
+
+  it("pack RGBA into RGB like the portable kernel", []() {
+    ExpectSameAsPortable<PixelLayout::Rgba, PixelLayout::Rgb>(RgbFromRgbaPortable);
+  });
+
+  it("turn RGBA gray like the portable kernel", []() {
+    ExpectSameAsPortable<PixelLayout::Rgba, PixelLayout::Gray>(GrayFromRgbaPortable);
+  });
+
+  it("swap red and blue like the portable kernel", []() {
+    ExpectSameAsPortable<PixelLayout::Rgba, PixelLayout::Bgra>(SwapRedBluePortable);
+  });
+
+  it("round-trip RGBA through BGRA", []() {
+    GuardedBytes rgba(33 * 4);
+    FillRandom(rgba, 33 * 4, 5);
+    std::vector<unsigned char> bgra(33 * 4);
+    std::vector<unsigned char> back(33 * 4);
+
+    ConvertPixels<PixelLayout::Rgba, PixelLayout::Bgra>(rgba.Data(), bgra.data(), 33);
+    ConvertPixels<PixelLayout::Bgra, PixelLayout::Rgba>(bgra.data(), back.data(), 33);
+
+    expect(back).toBe(rgba.Copy());
+  });
+
+  it("flip images row by row", []() {
+    const int width = 9;
+    const int height = 3;
+    GuardedBytes rgb(width * height * 3);
+    FillRandom(rgb, width * height * 3, 3);
+    std::vector<unsigned char> flipped(width * height * 4);
+    std::vector<unsigned char> expected(width * height * 4);
+
+    ConvertImage<PixelLayout::Rgb, PixelLayout::Rgba>(rgb.Data(), flipped.data(), width, height, true);
+    for (int y = 0; y < height; ++y)
+      RgbaFromRgbPortable(rgb.Data() + (height - 1 - y) * width * 3, expected.data() + y * width * 4, width);
+
+    expect(flipped).toBe(expected);
+  });
+});